@@ -17,8 +17,12 @@
 
 #include "PolicyManager.h"
 #include "Setting.h"
+#include "core/BandwidthPolicy.h"
+#include "core/CurlLoop.h"
+#include "core/InstallExecutor.h"
 #include "hawkbit/HawkBitClient.h"
 #include "hawkbit/HawkBitInfo.h"
+#include "hawkbit/PollingScheduler.h"
 #include "ls2/LS2Handler.h"
 #include "updater/FOSSInstaller.h"
 #include "util/Logger.h"
@@ -57,23 +61,31 @@ int main(int argc, char* argv[])
 
     // xxx: DON'T change initialization order.
     Setting::getInstance().initialize(s_mainloop);
+    InstallExecutor::getInstance().initialize(s_mainloop);
     LS2Handler::getInstance().initialize(s_mainloop);
     // FOSSInstaller::getInstance().initialize(s_mainloop);
     HawkBitInfo::getInstance().initialize(s_mainloop);
+    CurlLoop::getInstance().initialize(s_mainloop);
+    BandwidthPolicy::getInstance().initialize(s_mainloop);
     HawkBitClient::getInstance().initialize(s_mainloop);
+    PollingScheduler::getInstance().initialize(s_mainloop);
     PolicyManager::getInstance().initialize(s_mainloop);
 
     g_timeout_add_seconds(10, checkHawkBitInfoSet, NULL);
-    Logger::verbose("Main", "Start g_mainloop");
+    LOG_VERBOSE("Main", "Start g_mainloop");
     g_main_loop_run(s_mainloop);
-    Logger::verbose("Main", "Stop g_mainloop");
+    LOG_VERBOSE("Main", "Stop g_mainloop");
 
     // xxx: DON'T change finalize order.
     PolicyManager::getInstance().finalize();
+    PollingScheduler::getInstance().finalize();
     HawkBitClient::getInstance().finalize();
+    BandwidthPolicy::getInstance().finalize();
+    CurlLoop::getInstance().finalize();
     HawkBitInfo::getInstance().finalize();
     // FOSSInstaller::getInstance().finalize();
     LS2Handler::getInstance().finalize();
+    InstallExecutor::getInstance().finalize();
     Setting::getInstance().finalize();
 
     g_main_loop_unref(s_mainloop);
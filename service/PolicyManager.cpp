@@ -15,8 +15,11 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "PolicyManager.h"
+#include "Setting.h"
 #include "core/AbsAction.h"
+#include "core/BandwidthPolicy.h"
 #include "hawkbit/HawkBitInfo.h"
+#include "hawkbit/PollingScheduler.h"
 #include "ls2/AppInstaller.h"
 #include "ls2/NotificationManager.h"
 #include "ls2/SettingsService.h"
@@ -34,17 +37,24 @@ gboolean PolicyManager::_tick(gpointer user_data)
         getInstance().m_pendingClearRequest = false;
         getInstance().postStatus();
     }
-    HawkBitClient::getInstance().poll();
+    getInstance().checkDownloadWindow();
+    // Polling is scheduled by PollingScheduler
+    PollingScheduler::getInstance().setActive(getInstance().m_currentAction != nullptr);
     return G_SOURCE_CONTINUE;
 }
 
 PolicyManager::PolicyManager()
     : m_currentAction(nullptr)
     , m_statusPoint(nullptr)
-    , m_tickInterval(0)
+    , m_deltaStatusPoint(nullptr)
+    , m_isStatusPosted(false)
+    , m_postedAction(nullptr)
+    , m_postedId("")
     , m_tickSrc(0)
     , m_pendingClearRequest(false)
     , m_isAutoUpdateOn(false)
+    , m_isPausedByPolicy(false)
+    , m_progressAggregator([this] { postStatus(); })
 {
     setClassName("PolicyManager");
 }
@@ -66,8 +76,14 @@ bool PolicyManager::onInitialization()
 
     m_statusPoint = new LS::SubscriptionPoint();
     m_statusPoint->setServiceHandle(&LS2Handler::getInstance());
+    m_deltaStatusPoint = new LS::SubscriptionPoint();
+    m_deltaStatusPoint->setServiceHandle(&LS2Handler::getInstance());
+    m_progressAggregator.setInterval(Setting::getInstance().getProgressInterval());
 
-    onPollingSleepAction(DEFAULT_TICK_INTERVAL);
+    m_tickSrc = g_timeout_add_seconds(DEFAULT_TICK_INTERVAL, _tick, nullptr);
+    if (m_tickSrc == 0) {
+        Logger::error(getClassName(), "Failed to start tick timer");
+    }
 
     if (Util::isFileExist(DeploymentActionComposite::FILE_NON_VOLITILE_REBOOTCHECK) &&
         !Util::isFileExist(DeploymentActionComposite::FILE_VOLITILE_REBOOTCHECK)) {
@@ -83,6 +99,8 @@ bool PolicyManager::onFinalization()
 {
     delete m_statusPoint;
     m_statusPoint = nullptr;
+    delete m_deltaStatusPoint;
+    m_deltaStatusPoint = nullptr;
     AbsUpdaterFactory::getInstance().finalize();
     LS2Handler::getInstance().setListener(nullptr);
     HawkBitClient::getInstance().setListener(nullptr);
@@ -137,16 +155,22 @@ void PolicyManager::onGetSystemSettingsSubscription(pbnjson::JValue subscription
 
 void PolicyManager::onGetStatus(LS::Message& request, JValue& requestPayload, JValue& responsePayload)
 {
-    if (m_currentAction) {
-        Logger::debug(getClassName(), "Try to post current action status");
-        m_currentAction->toJson(responsePayload);
-    } else {
-        Logger::debug(getClassName(), "Current is null.");
-        responsePayload.put("id", nullptr);
-        responsePayload.put("status", Status::toString(StatusType_IDLE));
+    bool isDelta = requestPayload["delta"].asBool();
+
+    if (isDelta && m_deltaStatusPoint && request.isSubscription()) {
+        // Bring other delta subscribers up to date. Deltas of everyone start from this status.
+        postStatus();
+        getStatusJson(responsePayload);
+        LOG_DEBUG(getClassName(), "Add delta subscription");
+        responsePayload.put("subscribed", m_deltaStatusPoint->subscribe(request));
+        return;
     }
+
+    // Subscribers get the changes before they are consumed by this response
+    postStatus();
+    getStatusJson(responsePayload);
     if (m_statusPoint && request.isSubscription()) {
-        Logger::debug(getClassName(), "Add subscription");
+        LOG_DEBUG(getClassName(), "Add subscription");
         responsePayload.put("subscribed", m_statusPoint->subscribe(request));
     } else {
         responsePayload.put("subscribed", false);
@@ -156,7 +180,31 @@ void PolicyManager::onGetStatus(LS::Message& request, JValue& requestPayload, JV
 void PolicyManager::onSetConfig(LS::Message& request, JValue& requestPayload, JValue& responsePayload)
 {
     JValue data = requestPayload["data"];
-    HawkBitClient::getInstance().putConfigData(data);
+    // Respond with the result of the server, without blocking other requests
+    shared_ptr<LS2DeferredResponse> response = LS2Handler::defer(request, requestPayload);
+    HawkBitClient::getInstance().putConfigData(data, [response] (bool isDelivered, bool isRetrying) {
+        JValue responsePayload = pbnjson::Object();
+        if (!isDelivered && !isRetrying) {
+            responsePayload.put("errorText", "Config data is rejected");
+        } else {
+            // Not delivered yet, but it is sent again later
+            responsePayload.put("isDelivered", isDelivered);
+            responsePayload.put("isQueued", !isDelivered);
+        }
+        response->complete(responsePayload);
+    });
+
+    // Earlier feedbacks can be waiting to retry for minutes. Don't keep the caller waiting for them.
+    weak_ptr<LS2DeferredResponse> weakResponse = response;
+    Util::async([weakResponse] {
+        shared_ptr<LS2DeferredResponse> response = weakResponse.lock();
+        if (!response)
+            return;
+        JValue responsePayload = pbnjson::Object();
+        responsePayload.put("isDelivered", false);
+        responsePayload.put("isQueued", true);
+        response->complete(responsePayload);
+    }, CONFIG_RESPONSE_TIMEOUT);
 }
 
 void PolicyManager::onStartDownload(LS::Message& request, JValue& requestPayload, JValue& responsePayload)
@@ -169,6 +217,8 @@ void PolicyManager::onStartDownload(LS::Message& request, JValue& requestPayload
         responsePayload.put("errorText", "Cannot start download");
         return;
     }
+    // It is resumed in the download windows
+    checkDownloadWindow();
 }
 
 void PolicyManager::onPauseDownload(LS::Message& request, JValue& requestPayload, JValue& responsePayload)
@@ -181,6 +231,8 @@ void PolicyManager::onPauseDownload(LS::Message& request, JValue& requestPayload
         responsePayload.put("errorText", "Cannot pause download");
         return;
     }
+    // Paused by user. Don't resume it automatically.
+    m_isPausedByPolicy = false;
 }
 
 void PolicyManager::onResumeDownload(LS::Message& request, JValue& requestPayload, JValue& responsePayload)
@@ -189,6 +241,11 @@ void PolicyManager::onResumeDownload(LS::Message& request, JValue& requestPayloa
         responsePayload.put("errorText", "No active deployment action");
         return;
     }
+    if (!BandwidthPolicy::getInstance().isAllowed()) {
+        m_isPausedByPolicy = true;
+        responsePayload.put("errorText", "Out of download windows. It will be resumed in the windows");
+        return;
+    }
     if (!m_currentAction->resumeDownload()) {
         responsePayload.put("errorText", "Cannot resume download");
         return;
@@ -231,6 +288,25 @@ void PolicyManager::onCancelInstall(LS::Message& request, JValue& requestPayload
     }
 }
 
+void PolicyManager::onSetDownloadPolicy(LS::Message& request, JValue& requestPayload, JValue& responsePayload)
+{
+    if (!BandwidthPolicy::getInstance().fromJson(requestPayload)) {
+        responsePayload.put("errorText", "Invalid download policy");
+        return;
+    }
+
+    JValue downloadPolicy = pbnjson::Object();
+    BandwidthPolicy::getInstance().toJson(downloadPolicy);
+    responsePayload.put("downloadPolicy", downloadPolicy.duplicate());
+    // runtime state isn't saved
+    downloadPolicy.remove("isBackingOff");
+    if (!HawkBitInfo::getInstance().setDownloadPolicy(downloadPolicy)) {
+        responsePayload.put("errorText", "Failed to save download policy");
+        return;
+    }
+    checkDownloadWindow();
+}
+
 void PolicyManager::onCancellationAction(JValue& responsePayload)
 {
     string id;
@@ -286,6 +362,7 @@ void PolicyManager::onInstallationAction(JValue& responsePayload)
     m_currentAction = make_shared<DeploymentActionComposite>();
     m_currentAction->setListener(this);
     m_currentAction->fromJson(responsePayload);
+    PollingScheduler::getInstance().setActive(true);
 
     // process actionHistory
     string messageStr;
@@ -309,23 +386,7 @@ void PolicyManager::onInstallationAction(JValue& responsePayload)
 
 void PolicyManager::onPollingSleepAction(int seconds)
 {
-    if (m_tickInterval == seconds) {
-        Logger::verbose(getClassName(), "Same polling interval. Ignored");
-        return;
-    }
-    if (m_tickSrc > 0) {
-        g_source_remove(m_tickSrc);
-        m_tickSrc = 0;
-        m_tickInterval = 0;
-        Logger::info(getClassName(), "Tick source was removed");
-    }
-    m_tickSrc = g_timeout_add_seconds(seconds, _tick, nullptr);
-    if (m_tickSrc == 0) {
-        Logger::error(getClassName(), "Failed to start tick timer");
-        return;
-    }
-    Logger::info(getClassName(), "Started tick timer");
-    m_tickInterval = seconds;
+    PollingScheduler::getInstance().setServerInterval(seconds);
 }
 
 void PolicyManager::onSettingConfigData()
@@ -349,14 +410,20 @@ void PolicyManager::onSettingConfigData()
 
 void PolicyManager::onChangedStatus(Composite* deploymentAction)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
-    postStatus();
+    // State transitions are posted at once with the pending progress
+    m_progressAggregator.flush();
+}
+
+void PolicyManager::onChangedProgress(Composite* deploymentAction)
+{
+    m_progressAggregator.update();
 }
 
 void PolicyManager::onCompletedDownload(Composite* deploymentAction)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     Logger::info(getClassName(), "Download completed.");
 
@@ -367,7 +434,7 @@ void PolicyManager::onCompletedDownload(Composite* deploymentAction)
 
 void PolicyManager::onCompletedInstall(Composite* deploymentAction)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     m_pendingClearRequest = true;
     HawkBitClient::getInstance().postDeploymentAction(m_currentAction->getId(), true);
@@ -377,7 +444,7 @@ void PolicyManager::onCompletedInstall(Composite* deploymentAction)
 
 void PolicyManager::onFailedDownload(Composite* deploymentAction)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     m_pendingClearRequest = true;
     HawkBitClient::getInstance().postDeploymentAction(m_currentAction->getId(), false);
@@ -387,7 +454,7 @@ void PolicyManager::onFailedDownload(Composite* deploymentAction)
 
 void PolicyManager::onFailedInstall(Composite* deploymentAction)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     m_pendingClearRequest = true;
     HawkBitClient::getInstance().postDeploymentAction(m_currentAction->getId(), false);
@@ -395,26 +462,84 @@ void PolicyManager::onFailedInstall(Composite* deploymentAction)
     Logger::info(getClassName(), "Install failed.");
 }
 
+void PolicyManager::checkDownloadWindow()
+{
+    if (!m_currentAction) {
+        m_isPausedByPolicy = false;
+        return;
+    }
+
+    enum StatusType status = m_currentAction->getStatus().getStatus();
+    bool isAllowed = BandwidthPolicy::getInstance().isAllowed();
+    if (!isAllowed && status == StatusType_DOWNLOAD_STARTED) {
+        Logger::info(getClassName(), "Out of download windows. Pause download");
+        if (m_currentAction->pauseDownload())
+            m_isPausedByPolicy = true;
+    } else if (isAllowed && status == StatusType_DOWNLOAD_PAUSED && m_isPausedByPolicy) {
+        Logger::info(getClassName(), "In download windows. Resume download");
+        if (m_currentAction->resumeDownload())
+            m_isPausedByPolicy = false;
+    } else if (status != StatusType_DOWNLOAD_PAUSED) {
+        m_isPausedByPolicy = false;
+    }
+}
+
+void PolicyManager::getStatusJson(JValue& json)
+{
+    if (m_currentAction) {
+        LOG_DEBUG(getClassName(), "Try to post current action status");
+        // Top level fields are copied. Fragments of the cache are shared and not modified.
+        JValue cached = m_currentAction->toCachedJson();
+        for (auto it : cached.children()) {
+            json.put(it.first.asString(), it.second);
+        }
+    } else {
+        LOG_DEBUG(getClassName(), "Current is null.");
+        json.put("id", nullptr);
+        json.put("status", Status::toString(StatusType_IDLE));
+    }
+}
+
 void PolicyManager::postStatus()
 {
-    static JValue prev;
-    JValue cur = pbnjson::Object();
+    bool hasSubscribers = m_statusPoint && m_statusPoint->getSubscribersCount() > 0;
+    bool hasDeltaSubscribers = m_deltaStatusPoint && m_deltaStatusPoint->getSubscribersCount() > 0;
 
     // post subscription
-    if (!m_statusPoint || m_statusPoint->getSubscribersCount() == 0)
+    if (!hasSubscribers && !hasDeltaSubscribers)
         return;
 
-    if (!m_currentAction) {
-        cur.put("id", nullptr);
-        cur.put("status", Status::toString(StatusType_IDLE));
-    } else {
-        m_currentAction->toJson(cur);
+    string id = m_currentAction ? m_currentAction->getId() : "";
+    bool isActionChanged = !m_isStatusPosted || m_postedAction != m_currentAction.get() || m_postedId != id;
+    // Nothing is changed since the previous post
+    if (!isActionChanged && (!m_currentAction || !m_currentAction->isDirty()))
+        return;
+    m_isStatusPosted = true;
+    m_postedAction = m_currentAction.get();
+    m_postedId = id;
+
+    if (hasDeltaSubscribers) {
+        JValue delta = pbnjson::Object();
+        if (isActionChanged) {
+            // The whole status is replaced
+            getStatusJson(delta);
+            delta.put("delta", false);
+        } else {
+            delta = m_currentAction->toDeltaJson();
+            delta.put("delta", true);
+        }
+        delta.put("subscribed", true);
+        delta.put("returnValue", true);
+        LS2Handler::writeBLog("Post", "/getStatus", delta);
+        m_deltaStatusPoint->post(delta.stringify().c_str());
     }
+
+    if (!hasSubscribers)
+        return;
+    JValue cur = pbnjson::Object();
+    getStatusJson(cur);
     cur.put("subscribed", true);
     cur.put("returnValue", true);
-    if (prev != cur) {
-        LS2Handler::writeBLog("Post", "/getStatus", cur);
-        m_statusPoint->post(cur.stringify().c_str());
-        prev = cur.duplicate();
-    }
+    LS2Handler::writeBLog("Post", "/getStatus", cur);
+    m_statusPoint->post(cur.stringify().c_str());
 }
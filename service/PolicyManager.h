@@ -21,6 +21,7 @@
 
 #include "bootloader/AbsBootloader.h"
 #include "core/AbsAction.h"
+#include "core/ProgressAggregator.h"
 #include "core/install/impl/DeploymentActionComposite.h"
 #include "hawkbit/HawkBitClient.h"
 #include "interface/IInitializable.h"
@@ -61,6 +62,7 @@ public:
     virtual void onCancelDownload(LS::Message& request, JValue& requestPayload, JValue& responsePayload) override;
     virtual void onStartInstall(LS::Message& request, JValue& requestPayload, JValue& responsePayload) override;
     virtual void onCancelInstall(LS::Message& request, JValue& requestPayload, JValue& responsePayload) override;
+    virtual void onSetDownloadPolicy(LS::Message& request, JValue& requestPayload, JValue& responsePayload) override;
 
     // HawkBitClientListener
     virtual void onCancellationAction(JValue& responsePayload) override;
@@ -70,6 +72,7 @@ public:
 
     // DeploymentActionCompositeListener
     virtual void onChangedStatus(Composite* deploymentAction) override;
+    virtual void onChangedProgress(Composite* deploymentAction) override;
     virtual void onCompletedDownload(Composite* deploymentAction) override;
     virtual void onCompletedInstall(Composite* deploymentAction) override;
     virtual void onFailedDownload(Composite* deploymentAction) override;
@@ -80,20 +83,37 @@ public:
 private:
     PolicyManager();
 
+    void getStatusJson(JValue& json);
     void postStatus();
+    // pause or resume the download by the download windows
+    void checkDownloadWindow();
 
     static const int DEFAULT_TICK_INTERVAL = 15;
+    // '/setConfig' waits for hawkBit up to this (ms). Then it responds that the config data is queued.
+    static const guint CONFIG_RESPONSE_TIMEOUT = 3000;
 
     shared_ptr<DeploymentActionComposite> m_currentAction;
     LS::SubscriptionPoint *m_statusPoint;
-
-    int m_tickInterval;
+    // subscribers of '"delta": true' get only the fields changed since the previous post
+    LS::SubscriptionPoint *m_deltaStatusPoint;
+    // action of the previous post. Only compared to detect that the action is replaced.
+    bool m_isStatusPosted;
+    DeploymentActionComposite* m_postedAction;
+    string m_postedId;
+
+    // housekeeping of the current action. Polling has its own timer.
     guint m_tickSrc;
 
     // TODO this is a temp solution. it should be changed *queue* before polling
     bool m_pendingClearRequest;
 
     bool m_isAutoUpdateOn;
+
+    // download is paused because it's out of the download windows
+    bool m_isPausedByPolicy;
+
+    // progress of downloading and installing is posted once per interval
+    ProgressAggregator m_progressAggregator;
 };
 
 #endif /* POLICYMANAGER_H_ */
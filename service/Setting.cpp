@@ -14,12 +14,19 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "Setting.h"
 #include "util/Logger.h"
 
 Setting::Setting()
+    : m_deltaSourceWindow(64 * 1024 * 1024)
+    , m_maxDownloads(3)
+    , m_isPipelinedInstall(false)
+    , m_isCompareWrite(false)
+    , m_progressInterval(1000)
 {
     setClassName("Setting");
 }
@@ -33,6 +40,12 @@ void Setting::printHelp()
     cout << "Usage) ENV_OPTIONS /usr/sbin/swupdater"<< endl;
     cout << "Option) LOG_TYPE=[pmlog|console]"<< endl;
     cout << "Option) LOG_LEVEL=[verbose|debug|info|warning|error]"<< endl;
+    cout << "Option) LOG_MODE=[sync|async] (default: async)"<< endl;
+    cout << "Option) DELTA_SOURCE_WINDOW=[size in MB, 4 to 1024] (default: 64)"<< endl;
+    cout << "Option) MAX_DOWNLOADS=[count] (default: 3)"<< endl;
+    cout << "Option) INSTALL_MODE=[sequential|pipelined] (default: sequential)"<< endl;
+    cout << "Option) WRITE_MODE=[overwrite|compare] (default: overwrite)"<< endl;
+    cout << "Option) PROGRESS_INTERVAL=[milliseconds] (default: 1000)"<< endl;
     cout << "Example) LOG_TYPE=console LOG_LEVEL=verbose /usr/sbin/swupdater"<< endl;
 }
 
@@ -57,10 +70,56 @@ bool Setting::onInitialization()
     } else if (env && strcmp(env, "error") == 0) {
         Logger::getInstance().setLevel(LogLevel_ERROR);
     }
+
+    env = std::getenv("LOG_MODE");
+    if (env && strcmp(env, "sync") == 0) {
+        Logger::getInstance().setAsync(false);
+    } else {
+        Logger::getInstance().setAsync(true);
+    }
+
+    env = std::getenv("DELTA_SOURCE_WINDOW");
+    if (env) {
+        // At least one source block (4MB). Invalid value keeps the default.
+        char* end = nullptr;
+        errno = 0;
+        unsigned long size = strtoul(env, &end, 10);
+        if (errno == 0 && end != env && *end == '\0' && size >= 4 && size <= 1024) {
+            m_deltaSourceWindow = (size_t) size * 1024 * 1024;
+        } else {
+            Logger::warning(getClassName(), __FUNCTION__, "Invalid DELTA_SOURCE_WINDOW : " + string(env));
+        }
+    }
+
+    env = std::getenv("MAX_DOWNLOADS");
+    if (env && atoi(env) > 0) {
+        m_maxDownloads = (unsigned int) atoi(env);
+    }
+
+    env = std::getenv("INSTALL_MODE");
+    if (env && strcmp(env, "pipelined") == 0) {
+        m_isPipelinedInstall = true;
+    } else if (env && strcmp(env, "sequential") == 0) {
+        m_isPipelinedInstall = false;
+    }
+
+    env = std::getenv("WRITE_MODE");
+    if (env && strcmp(env, "compare") == 0) {
+        m_isCompareWrite = true;
+    } else if (env && strcmp(env, "overwrite") == 0) {
+        m_isCompareWrite = false;
+    }
+
+    env = std::getenv("PROGRESS_INTERVAL");
+    if (env && atoi(env) >= 0) {
+        m_progressInterval = (unsigned int) atoi(env);
+    }
     return true;
 }
 
 bool Setting::onFinalization()
 {
+    // Write all queued logs before exit
+    Logger::getInstance().setAsync(false);
     return true;
 }
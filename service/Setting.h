@@ -34,6 +34,7 @@
 
 #define PATH_PREFERENCE                     "/var/preferences/" NAME_SWUPDATER
 #define FILE_HAWKBIT_INFO                   "hawkBitInfo.json"
+#define FILE_FEEDBACK_OUTBOX                "feedbackOutbox.journal"
 #endif
 
 using namespace std;
@@ -48,8 +49,44 @@ public:
     virtual bool onInitialization() override;
     virtual bool onFinalization() override;
 
+    // bytes of the source partition cached while applying a delta
+    size_t getDeltaSourceWindow()
+    {
+        return m_deltaSourceWindow;
+    }
+
+    // number of artifacts downloaded at once
+    unsigned int getMaxDownloads()
+    {
+        return m_maxDownloads;
+    }
+
+    // install each software module as soon as it is downloaded
+    bool isPipelinedInstall()
+    {
+        return m_isPipelinedInstall;
+    }
+
+    // skip the blocks which are same in the partition already
+    bool isCompareWrite()
+    {
+        return m_isCompareWrite;
+    }
+
+    // minimum milliseconds between progress posts to status subscribers
+    unsigned int getProgressInterval()
+    {
+        return m_progressInterval;
+    }
+
 private:
     Setting();
+
+    size_t m_deltaSourceWindow;
+    unsigned int m_maxDownloads;
+    bool m_isPipelinedInstall;
+    bool m_isCompareWrite;
+    unsigned int m_progressInterval;
 };
 
 #endif /* SETTING_H_ */
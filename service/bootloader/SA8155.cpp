@@ -57,7 +57,7 @@ string SA8155::getEnv(const string& key)
 
 void SA8155::notifyUpdate()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     int bootSlot = getBootSlot();
     int nextSlot = (bootSlot == 1) ? 0 : 1;
@@ -66,23 +66,23 @@ void SA8155::notifyUpdate()
 
 void SA8155::setBootSuccess()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     libabctl_SetBootSuccess();
 }
 
 int SA8155::getBootSlot()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     int bootSlot = libabctl_getBootSlot();
-    Logger::debug(getClassName(), __FUNCTION__, to_string(bootSlot));
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(bootSlot));
     return bootSlot;
 }
 
 int SA8155::setActive(int slot)
 {
-    Logger::debug(getClassName(), __FUNCTION__, to_string(slot));
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(slot));
 
     return libabctl_setActive(slot);
 }
@@ -0,0 +1,298 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "core/BandwidthPolicy.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "hawkbit/HawkBitInfo.h"
+#include "util/JValueUtil.h"
+#include "util/Logger.h"
+
+BandwidthPolicy::BandwidthPolicy()
+    : m_maxRate(0)
+    , m_isAdaptive(false)
+    , m_adaptiveRate(128 * 1024)
+    , m_foregroundThreshold(256 * 1024)
+    , m_sampleSource(0)
+    , m_received(0)
+    , m_prevReceived(0)
+    , m_prevTotal(0)
+    , m_isBackingOff(false)
+    , m_quietSamples(0)
+    , m_appliedRate(0)
+{
+    setClassName("BandwidthPolicy");
+}
+
+BandwidthPolicy::~BandwidthPolicy()
+{
+}
+
+bool BandwidthPolicy::onInitialization()
+{
+    JValue json = HawkBitInfo::getInstance().getDownloadPolicy();
+    if (json.isObject() && !fromJson(json))
+        Logger::warning(getClassName(), "Saved download policy is ignored");
+    return true;
+}
+
+bool BandwidthPolicy::onFinalization()
+{
+    if (m_sampleSource > 0) {
+        g_source_remove(m_sampleSource);
+        m_sampleSource = 0;
+    }
+    m_handles.clear();
+    return true;
+}
+
+bool BandwidthPolicy::fromJson(const JValue& json)
+{
+    // All values are checked first. Nothing is changed by an invalid policy.
+    int64_t maxRate = m_maxRate;
+    bool isAdaptive = m_isAdaptive;
+    int64_t adaptiveRate = m_adaptiveRate;
+    int64_t foregroundThreshold = m_foregroundThreshold;
+    vector<Window> windows = m_windows;
+
+    if (json.hasKey("maxRate") && (!JValueUtil::getValue(json, "maxRate", maxRate) || maxRate < 0)) {
+        Logger::warning(getClassName(), "Invalid maxRate", json["maxRate"].stringify());
+        return false;
+    }
+    if (json.hasKey("adaptive")) {
+        if (!json["adaptive"].isBoolean()) {
+            Logger::warning(getClassName(), "Invalid adaptive", json["adaptive"].stringify());
+            return false;
+        }
+        isAdaptive = json["adaptive"].asBool();
+    }
+    if (json.hasKey("adaptiveRate") && (!JValueUtil::getValue(json, "adaptiveRate", adaptiveRate) || adaptiveRate <= 0)) {
+        Logger::warning(getClassName(), "Invalid adaptiveRate", json["adaptiveRate"].stringify());
+        return false;
+    }
+    if (json.hasKey("foregroundThreshold") && (!JValueUtil::getValue(json, "foregroundThreshold", foregroundThreshold) || foregroundThreshold <= 0)) {
+        Logger::warning(getClassName(), "Invalid foregroundThreshold", json["foregroundThreshold"].stringify());
+        return false;
+    }
+    if (json.hasKey("windows")) {
+        if (!json["windows"].isArray()) {
+            Logger::warning(getClassName(), "Invalid windows", json["windows"].stringify());
+            return false;
+        }
+        windows.clear();
+        for (JValue item : json["windows"].items()) {
+            string start, end;
+            JValueUtil::getValue(item, "start", start);
+            JValueUtil::getValue(item, "end", end);
+            Window window = { toMinutes(start), toMinutes(end) };
+            if (window.start < 0 || window.end < 0) {
+                Logger::warning(getClassName(), "Invalid window", item.stringify());
+                return false;
+            }
+            windows.push_back(window);
+        }
+    }
+
+    m_maxRate = maxRate;
+    m_isAdaptive = isAdaptive;
+    m_adaptiveRate = adaptiveRate;
+    m_foregroundThreshold = foregroundThreshold;
+    m_windows = windows;
+
+    if (!m_isAdaptive)
+        m_isBackingOff = false;
+    if (m_isAdaptive && !m_handles.empty())
+        startSampling();
+    apply();
+    return true;
+}
+
+bool BandwidthPolicy::toJson(JValue& json)
+{
+    json.put("maxRate", (int64_t) m_maxRate);
+    json.put("adaptive", m_isAdaptive);
+    json.put("adaptiveRate", (int64_t) m_adaptiveRate);
+    json.put("foregroundThreshold", (int64_t) m_foregroundThreshold);
+    JValue windows = pbnjson::Array();
+    for (const Window& window : m_windows) {
+        JValue item = pbnjson::Object();
+        item.put("start", toString(window.start));
+        item.put("end", toString(window.end));
+        windows.append(item);
+    }
+    json.put("windows", windows);
+    json.put("isBackingOff", m_isBackingOff);
+    return true;
+}
+
+void BandwidthPolicy::add(CURL* easyHandle)
+{
+    m_handles.insert(easyHandle);
+    if (m_isAdaptive)
+        startSampling();
+    m_appliedRate = -1;
+    apply();
+}
+
+void BandwidthPolicy::remove(CURL* easyHandle)
+{
+    if (m_handles.erase(easyHandle) == 0)
+        return;
+    if (m_handles.empty()) {
+        // Nothing to sample while idle
+        if (m_sampleSource > 0) {
+            g_source_remove(m_sampleSource);
+            m_sampleSource = 0;
+        }
+        return;
+    }
+    m_appliedRate = -1;
+    apply();
+}
+
+bool BandwidthPolicy::isAllowed()
+{
+    if (m_windows.empty())
+        return true;
+
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    int minutes = tm.tm_hour * 60 + tm.tm_min;
+
+    for (const Window& window : m_windows) {
+        if (window.start <= window.end) {
+            if (window.start <= minutes && minutes < window.end)
+                return true;
+        } else if (minutes >= window.start || minutes < window.end) {
+            // crossing midnight. i.e. 23:00 ~ 05:00
+            return true;
+        }
+    }
+    return false;
+}
+
+gboolean BandwidthPolicy::onSample(gpointer data)
+{
+    BandwidthPolicy* self = static_cast<BandwidthPolicy*>(data);
+    self->sample();
+    if (self->m_isAdaptive)
+        return G_SOURCE_CONTINUE;
+    self->m_sampleSource = 0;
+    return G_SOURCE_REMOVE;
+}
+
+int BandwidthPolicy::toMinutes(const string& str)
+{
+    // "HH:MM" from "00:00" to "23:59"
+    if (str.size() != 5 || str[2] != ':' ||
+        !isdigit(str[0]) || !isdigit(str[1]) || !isdigit(str[3]) || !isdigit(str[4]))
+        return -1;
+    int hours = (str[0] - '0') * 10 + (str[1] - '0');
+    int minutes = (str[3] - '0') * 10 + (str[4] - '0');
+    if (hours > 23 || minutes > 59)
+        return -1;
+    return hours * 60 + minutes;
+}
+
+string BandwidthPolicy::toString(int minutes)
+{
+    char buff[8];
+    snprintf(buff, sizeof(buff), "%02d:%02d", minutes / 60, minutes % 60);
+    return buff;
+}
+
+size_t BandwidthPolicy::readTotalReceived()
+{
+    FILE* file = fopen("/proc/net/dev", "r");
+    if (file == nullptr)
+        return 0;
+
+    size_t total = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        char* colon = strchr(line, ':');
+        if (colon == nullptr)
+            continue; // header
+        *colon = '\0';
+        char* name = line;
+        while (*name == ' ')
+            name++;
+        if (strcmp(name, "lo") == 0)
+            continue;
+        unsigned long long bytes = 0;
+        if (sscanf(colon + 1, "%llu", &bytes) == 1)
+            total += bytes;
+    }
+    fclose(file);
+    return total;
+}
+
+void BandwidthPolicy::startSampling()
+{
+    if (m_sampleSource > 0)
+        return;
+    m_prevTotal = readTotalReceived();
+    m_prevReceived = m_received;
+    m_sampleSource = g_timeout_add_seconds(SAMPLE_INTERVAL, &BandwidthPolicy::onSample, this);
+}
+
+void BandwidthPolicy::sample()
+{
+    size_t total = readTotalReceived();
+    size_t others = 0;
+    // Traffic of other processes = all interfaces - our transfers
+    if (total > m_prevTotal && (total - m_prevTotal) > (m_received - m_prevReceived))
+        others = (total - m_prevTotal) - (m_received - m_prevReceived);
+    m_prevTotal = total;
+    m_prevReceived = m_received;
+
+    curl_off_t rate = others / SAMPLE_INTERVAL;
+    if (rate > m_foregroundThreshold) {
+        m_quietSamples = 0;
+        if (!m_isBackingOff) {
+            Logger::info(getClassName(), "Foreground traffic detected (" + to_string(rate) + " B/s). Back off");
+            m_isBackingOff = true;
+            apply();
+        }
+    } else if (m_isBackingOff && ++m_quietSamples >= QUIET_SAMPLES) {
+        Logger::info(getClassName(), "Foreground traffic is gone. Restore rate");
+        m_isBackingOff = false;
+        apply();
+    }
+}
+
+void BandwidthPolicy::apply()
+{
+    curl_off_t rate = m_maxRate;
+    if (m_isBackingOff && (rate == 0 || m_adaptiveRate < rate))
+        rate = m_adaptiveRate;
+    if (rate == m_appliedRate || m_handles.empty())
+        return;
+    m_appliedRate = rate;
+
+    // Each transfer gets the same share. 0 means unlimited.
+    curl_off_t share = (rate > 0) ? max<curl_off_t>(rate / m_handles.size(), 1) : 0;
+    for (CURL* easyHandle : m_handles) {
+        curl_easy_setopt(easyHandle, CURLOPT_MAX_RECV_SPEED_LARGE, share);
+    }
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(share) + " B/s x " + to_string(m_handles.size()));
+}
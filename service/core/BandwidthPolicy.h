@@ -0,0 +1,109 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef CORE_BANDWIDTHPOLICY_H_
+#define CORE_BANDWIDTHPOLICY_H_
+
+#include <iostream>
+#include <set>
+#include <vector>
+#include <curl/curl.h>
+#include <glib.h>
+#include <pbnjson.hpp>
+
+#include "interface/IInitializable.h"
+#include "interface/ISerializable.h"
+#include "interface/ISingleton.h"
+
+using namespace std;
+using namespace pbnjson;
+
+// Limits the download bandwidth of HttpFile, and decides when downloading is allowed.
+//
+// {
+//     "maxRate": 1048576,              // bytes per second for all downloads. 0 is unlimited.
+//     "adaptive": true,                // back off while other traffic is detected
+//     "adaptiveRate": 131072,          // bytes per second while backing off
+//     "foregroundThreshold": 262144,   // bytes per second of other traffic regarded as foreground
+//     "windows": [ { "start": "01:00", "end": "05:00" } ]  // local time. Empty is always.
+// }
+class BandwidthPolicy : public IInitializable,
+                        public ISerializable,
+                        public ISingleton<BandwidthPolicy> {
+friend class ISingleton<BandwidthPolicy>;
+public:
+    virtual ~BandwidthPolicy();
+
+    // IInitializable
+    virtual bool onInitialization() override;
+    virtual bool onFinalization() override;
+
+    // ISerializable
+    virtual bool fromJson(const JValue& json) override;
+    virtual bool toJson(JValue& json) override;
+
+    // Running transfers share the rate
+    void add(CURL* easyHandle);
+    void remove(CURL* easyHandle);
+    // Bytes received by the transfers. It is used to tell other traffic.
+    void onReceived(size_t size)
+    {
+        m_received += size;
+    }
+
+    // Whether the current local time is in the download windows
+    bool isAllowed();
+
+private:
+    struct Window {
+        int start; // minutes from midnight
+        int end;
+    };
+
+    static const guint SAMPLE_INTERVAL = 2;
+    static const int QUIET_SAMPLES = 3;
+
+    static gboolean onSample(gpointer data);
+    static int toMinutes(const string& str);
+    static string toString(int minutes);
+    static size_t readTotalReceived();
+
+    BandwidthPolicy();
+
+    void startSampling();
+    void sample();
+    void apply();
+
+    // config
+    curl_off_t m_maxRate;
+    bool m_isAdaptive;
+    curl_off_t m_adaptiveRate;
+    curl_off_t m_foregroundThreshold;
+    vector<Window> m_windows;
+
+    // state
+    set<CURL*> m_handles;
+    guint m_sampleSource;
+    size_t m_received;
+    size_t m_prevReceived;
+    size_t m_prevTotal;
+    bool m_isBackingOff;
+    int m_quietSamples;
+    curl_off_t m_appliedRate;
+};
+
+#endif /* CORE_BANDWIDTHPOLICY_H_ */
@@ -0,0 +1,292 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "core/CurlLoop.h"
+
+#include "util/Logger.h"
+
+CurlLoop::CurlLoop()
+    : m_multiHandle(nullptr)
+    , m_timerSource(0)
+    , m_shareHandle(nullptr)
+{
+    setClassName("CurlLoop");
+}
+
+CurlLoop::~CurlLoop()
+{
+}
+
+bool CurlLoop::onInitialization()
+{
+    CURLMcode rc = CURLM_OK;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    m_multiHandle = curl_multi_init();
+    if (m_multiHandle == nullptr) {
+        Logger::error(getClassName(), "Failed in curl_multi_init");
+        return false;
+    }
+    rc = curl_multi_setopt(m_multiHandle, CURLMOPT_SOCKETFUNCTION, &CurlLoop::onSocket);
+    if (rc != CURLM_OK) {
+        goto Done;
+    }
+    rc = curl_multi_setopt(m_multiHandle, CURLMOPT_SOCKETDATA, this);
+    if (rc != CURLM_OK) {
+        goto Done;
+    }
+    rc = curl_multi_setopt(m_multiHandle, CURLMOPT_TIMERFUNCTION, &CurlLoop::onTimer);
+    if (rc != CURLM_OK) {
+        goto Done;
+    }
+    rc = curl_multi_setopt(m_multiHandle, CURLMOPT_TIMERDATA, this);
+    if (rc != CURLM_OK) {
+        goto Done;
+    }
+
+Done:
+    if (rc != CURLM_OK) {
+        Logger::error(getClassName(), "Failed in curl_multi_setopt", curl_multi_strerror(rc));
+        return false;
+    }
+
+    m_shareHandle = curl_share_init();
+    if (m_shareHandle == nullptr) {
+        // Requests still work without sharing
+        Logger::warning(getClassName(), "Failed in curl_share_init");
+        return true;
+    }
+    curl_share_setopt(m_shareHandle, CURLSHOPT_LOCKFUNC, &CurlLoop::onLockShare);
+    curl_share_setopt(m_shareHandle, CURLSHOPT_UNLOCKFUNC, &CurlLoop::onUnlockShare);
+    curl_share_setopt(m_shareHandle, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (curl_share_setopt(m_shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT) != CURLSHE_OK) {
+        // libcurl < 7.57.0. Connections are reused in the multi handle only.
+        Logger::info(getClassName(), "Connection cache is not shared");
+    }
+    return true;
+}
+
+bool CurlLoop::onFinalization()
+{
+    if (m_timerSource > 0) {
+        g_source_remove(m_timerSource);
+        m_timerSource = 0;
+    }
+    while (!m_watches.empty()) {
+        removeWatch(m_watches.begin()->first);
+    }
+    if (m_multiHandle) {
+        curl_multi_cleanup(m_multiHandle);
+        m_multiHandle = nullptr;
+    }
+    for (CURL* easyHandle : m_handles) {
+        curl_easy_cleanup(easyHandle);
+    }
+    m_handles.clear();
+    if (m_shareHandle) {
+        curl_share_cleanup(m_shareHandle);
+        m_shareHandle = nullptr;
+    }
+    curl_global_cleanup();
+    return true;
+}
+
+bool CurlLoop::add(CURL* easyHandle, CurlLoopListener* listener)
+{
+    CURLcode rc = curl_easy_setopt(easyHandle, CURLOPT_PRIVATE, listener);
+    if (rc != CURLE_OK) {
+        Logger::error(getClassName(), "Failed in curl_easy_setopt(PRIVATE)", curl_easy_strerror(rc));
+        return false;
+    }
+    // The transfer is started by the timer which curl sets in this call
+    CURLMcode mrc = curl_multi_add_handle(m_multiHandle, easyHandle);
+    if (mrc != CURLM_OK) {
+        Logger::error(getClassName(), "Failed in curl_multi_add_handle", curl_multi_strerror(mrc));
+        return false;
+    }
+    return true;
+}
+
+bool CurlLoop::remove(CURL* easyHandle)
+{
+    CURLMcode rc = curl_multi_remove_handle(m_multiHandle, easyHandle);
+    if (rc != CURLM_OK) {
+        Logger::error(getClassName(), "Failed in curl_multi_remove_handle", curl_multi_strerror(rc));
+        return false;
+    }
+    return true;
+}
+
+CURL* CurlLoop::acquireHandle()
+{
+    CURL* easyHandle = nullptr;
+    if (!m_handles.empty()) {
+        easyHandle = m_handles.front();
+        m_handles.pop_front();
+    } else {
+        easyHandle = curl_easy_init();
+        if (easyHandle == nullptr) {
+            Logger::error(getClassName(), "Failed in curl_easy_init");
+            return nullptr;
+        }
+    }
+    if (m_shareHandle) {
+        curl_easy_setopt(easyHandle, CURLOPT_SHARE, m_shareHandle);
+    }
+    return easyHandle;
+}
+
+void CurlLoop::releaseHandle(CURL* easyHandle)
+{
+    if (easyHandle == nullptr) {
+        return;
+    }
+    // Pool is gone after finalization
+    if (m_multiHandle == nullptr || m_handles.size() >= MAX_POOLED_HANDLES) {
+        curl_easy_cleanup(easyHandle);
+        return;
+    }
+    // Options are cleared, but live connections and caches are kept
+    curl_easy_reset(easyHandle);
+    m_handles.push_back(easyHandle);
+}
+
+int CurlLoop::onSocket(CURL* easyHandle, curl_socket_t socket, int what, void* userp, void* socketp)
+{
+    CurlLoop* self = static_cast<CurlLoop*>(userp);
+
+    self->removeWatch(socket);
+    if (what == CURL_POLL_REMOVE) {
+        return 0;
+    }
+
+    int condition = G_IO_ERR | G_IO_HUP;
+    if (what & CURL_POLL_IN)
+        condition |= G_IO_IN;
+    if (what & CURL_POLL_OUT)
+        condition |= G_IO_OUT;
+
+    SocketWatch watch;
+    watch.channel = g_io_channel_unix_new(socket);
+    watch.source = g_io_add_watch(watch.channel, (GIOCondition) condition, &CurlLoop::onSocketEvent, self);
+    self->m_watches[socket] = watch;
+    return 0;
+}
+
+int CurlLoop::onTimer(CURLM* multiHandle, long timeout, void* userp)
+{
+    CurlLoop* self = static_cast<CurlLoop*>(userp);
+
+    if (self->m_timerSource > 0) {
+        g_source_remove(self->m_timerSource);
+        self->m_timerSource = 0;
+    }
+    // -1 means that the timer should be deleted
+    if (timeout >= 0) {
+        self->m_timerSource = g_timeout_add((guint) timeout, &CurlLoop::onTimeout, self);
+    }
+    return 0;
+}
+
+gboolean CurlLoop::onSocketEvent(GIOChannel* channel, GIOCondition condition, gpointer data)
+{
+    CurlLoop* self = static_cast<CurlLoop*>(data);
+
+    int events = 0;
+    if (condition & G_IO_IN)
+        events |= CURL_CSELECT_IN;
+    if (condition & G_IO_OUT)
+        events |= CURL_CSELECT_OUT;
+    if (condition & (G_IO_ERR | G_IO_HUP))
+        events |= CURL_CSELECT_ERR;
+
+    curl_socket_t socket = g_io_channel_unix_get_fd(channel);
+    self->action(socket, events);
+    // The watch is replaced or removed in 'onSocket' if curl wants it
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean CurlLoop::onTimeout(gpointer data)
+{
+    CurlLoop* self = static_cast<CurlLoop*>(data);
+
+    self->m_timerSource = 0;
+    self->action(CURL_SOCKET_TIMEOUT, 0);
+    return G_SOURCE_REMOVE;
+}
+
+void CurlLoop::onLockShare(CURL* easyHandle, curl_lock_data data, curl_lock_access access, void* userp)
+{
+    CurlLoop* self = static_cast<CurlLoop*>(userp);
+    self->m_shareLocks[data].lock();
+}
+
+void CurlLoop::onUnlockShare(CURL* easyHandle, curl_lock_data data, void* userp)
+{
+    CurlLoop* self = static_cast<CurlLoop*>(userp);
+    self->m_shareLocks[data].unlock();
+}
+
+void CurlLoop::action(curl_socket_t socket, int events)
+{
+    int running = 0;
+    CURLMcode rc = curl_multi_socket_action(m_multiHandle, socket, events, &running);
+    if (rc != CURLM_OK) {
+        Logger::error(getClassName(), "Failed in curl_multi_socket_action", curl_multi_strerror(rc));
+    }
+    checkFinished();
+}
+
+void CurlLoop::removeWatch(curl_socket_t socket)
+{
+    auto it = m_watches.find(socket);
+    if (it == m_watches.end()) {
+        return;
+    }
+    g_source_remove(it->second.source);
+    g_io_channel_unref(it->second.channel);
+    m_watches.erase(it);
+}
+
+void CurlLoop::checkFinished()
+{
+    while (true) {
+        int size;
+        CURLMsg* curlMsg = curl_multi_info_read(m_multiHandle, &size);
+        if (curlMsg == nullptr) {
+            break;
+        }
+
+        if (curlMsg->msg != CURLMSG_DONE) {
+            Logger::warning(getClassName(), "Unknown CURLMsg");
+            continue;
+        }
+
+        CurlLoopListener* listener = nullptr;
+        CURLcode rc = curl_easy_getinfo(curlMsg->easy_handle, CURLINFO_PRIVATE, (char**) &listener);
+        if (rc != CURLE_OK || listener == nullptr) {
+            Logger::error(getClassName(), "Listener is null");
+            curl_multi_remove_handle(m_multiHandle, curlMsg->easy_handle);
+            continue;
+        }
+
+        // 'listener' can be deleted in the callback. Don't touch it after the call.
+        listener->onFinishedTransfer(curlMsg->data.result);
+    }
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef CORE_CURLLOOP_H_
+#define CORE_CURLLOOP_H_
+
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <curl/curl.h>
+#include <glib.h>
+
+#include "interface/IInitializable.h"
+#include "interface/ISingleton.h"
+
+using namespace std;
+
+class CurlLoopListener {
+public:
+    CurlLoopListener() {}
+    virtual ~CurlLoopListener() {}
+
+    // Called on the main loop when the transfer of the easy handle is finished
+    virtual void onFinishedTransfer(CURLcode result) = 0;
+};
+
+// Drives the curl multi handle from the GLib main loop with 'curl_multi_socket_action'.
+// Each socket has its own watch, and curl's timeout is a GLib timer. Nothing is polled while idle.
+class CurlLoop : public IInitializable,
+                 public ISingleton<CurlLoop> {
+friend class ISingleton<CurlLoop>;
+public:
+    virtual ~CurlLoop();
+
+    // IInitializable
+    virtual bool onInitialization() override;
+    virtual bool onFinalization() override;
+
+    // 'listener' is stored in CURLOPT_PRIVATE of the easy handle
+    bool add(CURL* easyHandle, CurlLoopListener* listener);
+    bool remove(CURL* easyHandle);
+
+    // Easy handles are reused. They share DNS cache, TLS sessions and connections,
+    // so requests to hawkBit don't pay the handshakes again.
+    CURL* acquireHandle();
+    void releaseHandle(CURL* easyHandle);
+
+    CURLM* getHandle()
+    {
+        return m_multiHandle;
+    }
+
+private:
+    struct SocketWatch {
+        GIOChannel* channel;
+        guint source;
+    };
+
+    static int onSocket(CURL* easyHandle, curl_socket_t socket, int what, void* userp, void* socketp);
+    static int onTimer(CURLM* multiHandle, long timeout, void* userp);
+    static gboolean onSocketEvent(GIOChannel* channel, GIOCondition condition, gpointer data);
+    static gboolean onTimeout(gpointer data);
+    static void onLockShare(CURL* easyHandle, curl_lock_data data, curl_lock_access access, void* userp);
+    static void onUnlockShare(CURL* easyHandle, curl_lock_data data, void* userp);
+
+    static const size_t MAX_POOLED_HANDLES = 8;
+
+    CurlLoop();
+
+    void action(curl_socket_t socket, int events);
+    void removeWatch(curl_socket_t socket);
+    void checkFinished();
+
+    CURLM* m_multiHandle;
+    map<curl_socket_t, SocketWatch> m_watches;
+    guint m_timerSource;
+
+    // pooled transport
+    CURLSH* m_shareHandle;
+    // curl locks them while the shared data is accessed
+    mutex m_shareLocks[CURL_LOCK_DATA_LAST];
+    deque<CURL*> m_handles;
+};
+
+#endif /* CORE_CURLLOOP_H_ */
@@ -0,0 +1,210 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "core/FileWriter.h"
+
+#include <chrono>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/Logger.h"
+
+FileWriter::FileWriter(int fd, uint64_t offset)
+    : m_fd(fd)
+    , m_offset(offset)
+    , m_readyCallback(nullptr)
+    , m_current(nullptr)
+    , m_isFinished(false)
+    , m_isStopping(false)
+    , m_isStalled(false)
+    , m_error(0)
+    , m_written(0)
+    , m_writeCount(0)
+    , m_writeTime(0)
+    , m_stallCount(0)
+{
+    setClassName("FileWriter");
+}
+
+FileWriter::~FileWriter()
+{
+    stop();
+    for (Buffer& buffer : m_buffers) {
+        free(buffer.data);
+    }
+}
+
+bool FileWriter::open()
+{
+    m_buffers.resize(BUFFER_COUNT);
+    for (Buffer& buffer : m_buffers) {
+        buffer.data = nullptr;
+        buffer.length = 0;
+    }
+    for (Buffer& buffer : m_buffers) {
+        void* data = nullptr;
+        if (posix_memalign(&data, ALIGNMENT, BUFFER_SIZE) != 0) {
+            m_error = ENOMEM;
+            Logger::error(getClassName(), __FUNCTION__, "Failed to allocate buffer");
+            return false;
+        }
+        buffer.data = (uint8_t*) data;
+        m_freeBuffers.push_back(&buffer);
+    }
+    m_current = m_freeBuffers.front();
+    m_freeBuffers.pop_front();
+
+    m_thread = thread(&FileWriter::run, this);
+    return true;
+}
+
+bool FileWriter::write(const void* data, size_t size)
+{
+    const uint8_t* ptr = (const uint8_t*) data;
+
+    if (m_error != 0 || m_isFinished)
+        return false;
+
+    {
+        // Only the writer thread adds free buffers, so the space doesn't shrink until they are used here.
+        unique_lock<mutex> lock(m_mutex);
+        if (m_current == nullptr && !m_freeBuffers.empty()) {
+            m_current = m_freeBuffers.front();
+            m_freeBuffers.pop_front();
+        }
+        size_t space = (m_current ? BUFFER_SIZE - m_current->length : 0) + m_freeBuffers.size() * BUFFER_SIZE;
+        if (size > space) {
+            m_isStalled = true;
+            m_stallCount++;
+            return false;
+        }
+    }
+
+    while (size > 0) {
+        size_t length = min(size, BUFFER_SIZE - m_current->length);
+        memcpy(m_current->data + m_current->length, ptr, length);
+        m_current->length += length;
+        ptr += length;
+        size -= length;
+
+        if (m_current->length == BUFFER_SIZE)
+            submit();
+    }
+    return true;
+}
+
+bool FileWriter::finish()
+{
+    if (m_isFinished)
+        return false;
+    m_isFinished = true;
+
+    if (m_current != nullptr && m_current->length > 0) {
+        unique_lock<mutex> lock(m_mutex);
+        m_filledBuffers.push_back(m_current);
+    }
+    m_current = nullptr;
+    stop();
+
+    if (m_error != 0)
+        return false;
+
+    uint64_t time = m_writeTime;
+    uint64_t rate = (time > 0) ? m_written * 1000000 / time / 1024 : 0;
+    Logger::info(getClassName(), __FUNCTION__, to_string(m_written) + " bytes in " + to_string(m_writeCount) + " writes (" + to_string(rate) + " KB/s). Stalled " + to_string(m_stallCount) + " times");
+    return true;
+}
+
+void FileWriter::submit()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_filledBuffers.push_back(m_current);
+    m_current = nullptr;
+    m_condition.notify_all();
+
+    // 'write' checked the space for the rest of its data already
+    if (!m_freeBuffers.empty()) {
+        m_current = m_freeBuffers.front();
+        m_freeBuffers.pop_front();
+    }
+}
+
+void FileWriter::run()
+{
+    unique_lock<mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this] { return !m_filledBuffers.empty() || m_isStopping; });
+        if (m_filledBuffers.empty())
+            break;
+
+        Buffer* buffer = m_filledBuffers.front();
+        m_filledBuffers.pop_front();
+        lock.unlock();
+        bool result = (m_error == 0) && writeBuffer(buffer);
+        lock.lock();
+
+        buffer->length = 0;
+        m_freeBuffers.push_back(buffer);
+        // The caller waits for a free block (or for the failure to abort)
+        if (m_isStalled || !result) {
+            m_isStalled = false;
+            if (m_readyCallback) {
+                lock.unlock();
+                m_readyCallback();
+                lock.lock();
+            }
+        }
+        if (!result)
+            break;
+    }
+}
+
+bool FileWriter::writeBuffer(Buffer* buffer)
+{
+    auto begin = chrono::steady_clock::now();
+    size_t written = 0;
+
+    while (written < buffer->length) {
+        ssize_t length = pwrite(m_fd, buffer->data + written, buffer->length - written, m_offset + written);
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0) {
+            m_error = (length < 0) ? errno : EIO;
+            Logger::error(getClassName(), __FUNCTION__, "Failed to write file : " + string(strerror(m_error)));
+            return false;
+        }
+        written += length;
+        m_writeCount++;
+    }
+    m_offset += written;
+    m_written += written;
+    m_writeTime += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+    return true;
+}
+
+void FileWriter::stop()
+{
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_isStopping = true;
+        m_condition.notify_all();
+    }
+    if (m_thread.joinable())
+        m_thread.join();
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef CORE_FILEWRITER_H_
+#define CORE_FILEWRITER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "interface/IClassName.h"
+
+using namespace std;
+
+// Writes data sequentially to a file from 'offset' on a writer thread.
+// Data is gathered into large blocks on the caller's thread. Unlike BlockWriter, 'write' never waits:
+// it refuses the data while all blocks are being written, and the ready callback is called once a block is free.
+class FileWriter : public IClassName {
+public:
+    // Called on the writer thread
+    typedef function<void()> ReadyCallback;
+
+    // 'fd' is owned by the caller. It should be kept open until 'finish'.
+    FileWriter(int fd, uint64_t offset);
+    virtual ~FileWriter();
+
+    bool open();
+    // Returns false without taking any data if it doesn't fit in free blocks (or on failure. see 'getError')
+    bool write(const void* data, size_t size);
+    // Write the remaining data and wait for it. Nothing is written after this.
+    bool finish();
+
+    void setReadyCallback(ReadyCallback callback)
+    {
+        m_readyCallback = callback;
+    }
+
+    // errno of the first failure
+    int getError()
+    {
+        return m_error;
+    }
+
+    // bytes written to the file
+    uint64_t getWrittenSize()
+    {
+        return m_written;
+    }
+
+    // 'pwrite' calls and microseconds spent in them
+    uint64_t getWriteCount()
+    {
+        return m_writeCount;
+    }
+
+    uint64_t getWriteTime()
+    {
+        return m_writeTime;
+    }
+
+    // times 'write' refused the data because all blocks were busy
+    uint64_t getStallCount()
+    {
+        return m_stallCount;
+    }
+
+private:
+    static const size_t BUFFER_SIZE = 1024 * 1024;
+    static const size_t BUFFER_COUNT = 4;
+    static const size_t ALIGNMENT = 4096;
+
+    struct Buffer {
+        uint8_t* data;
+        size_t length;
+    };
+
+    void run();
+    void submit();
+    bool writeBuffer(Buffer* buffer);
+    void stop();
+
+    int m_fd;
+    uint64_t m_offset;
+    ReadyCallback m_readyCallback;
+
+    vector<Buffer> m_buffers;
+    deque<Buffer*> m_freeBuffers;
+    deque<Buffer*> m_filledBuffers;
+    Buffer* m_current;
+    bool m_isFinished;
+
+    thread m_thread;
+    mutex m_mutex;
+    condition_variable m_condition;
+    bool m_isStopping;
+    bool m_isStalled;
+
+    atomic<int> m_error;
+    atomic<uint64_t> m_written;
+    atomic<uint64_t> m_writeCount;
+    atomic<uint64_t> m_writeTime;
+    atomic<uint64_t> m_stallCount;
+};
+
+#endif /* CORE_FILEWRITER_H_ */
@@ -15,103 +15,169 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "core/HttpFile.h"
-#include "external/glibcurl.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
 #include "Setting.h"
+#include "core/BandwidthPolicy.h"
+#include "core/FileWriter.h"
+#include "util/Util.h"
 
-map<CURL*, HttpFile*> HttpFile::s_map;
+const string HttpFile::SEGMENTS_SUFFIX = ".segments";
+const string HttpFile::HASH_SUFFIX = ".hash";
+
+bool HttpFile::remove(const string& filename)
+{
+    Util::removeFile(filename + SEGMENTS_SUFFIX);
+    Util::removeFile(filename + HASH_SUFFIX);
+    return Util::removeFile(filename);
+}
+
+bool HttpFile::loadHash(const string& filename, HashContext& hash)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0 || Util::isFileExist(filename + SEGMENTS_SUFFIX)) {
+        return false;
+    }
+    if (!hash.load(filename + HASH_SUFFIX) || hash.getSize() != (uint64_t)st.st_size) {
+        return false;
+    }
+    return true;
+}
 
 HttpFile::HttpFile()
     : HttpRequest()
     , m_filename("")
-    , m_file(nullptr)
     , m_size(0)
+    , m_notifiedSize(0)
+    , m_segmentCount(1)
+    , m_total(0)
+    , m_savedSize(0)
+    , m_fd(-1)
+    , m_isRangeUnsupported(false)
 {
-    s_map[m_easyHandle] = this;
 }
 
 HttpFile::~HttpFile()
 {
-    s_map.erase(m_easyHandle);
+    stop();
+    stopSegments();
     close();
 }
 
 bool HttpFile::send(JValue request)
 {
-    CURLcode rc1;
-    CURLMcode rc2;
+    CURLcode rc;
 
-    if (m_filename.empty()) {
-        Logger::error(getClassName(), "'filename' is empty");
-        return false;
-    }
-    m_file = fopen(m_filename.c_str(), "ab");
-    if (m_file == nullptr) {
-        Logger::error(getClassName(), "Failed to open file : " + string(strerror(errno)));
-        return false;
-    }
-    Logger::verbose(getClassName(), "Open file - " + m_filename);
-    if (!prepare()) {
-        return false;
+    if (m_writer) {
+        if (!prepare()) {
+            return false;
+        }
+        m_size = 0;
+        m_hash.reset();
+    } else {
+        if (m_filename.empty()) {
+            Logger::error(getClassName(), "'filename' is empty");
+            return false;
+        }
+        if (m_segmentCount > 1 && m_total > 0) {
+            return sendSegments();
+        }
+        m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (m_fd < 0) {
+            Logger::error(getClassName(), "Failed to open file : " + string(strerror(errno)));
+            return false;
+        }
+        LOG_VERBOSE(getClassName(), "Open file - " + m_filename);
+        // Blocks are allocated beyond the end of file. The file size is still the resume position.
+        if (!preallocate(true) || !prepare()) {
+            close();
+            return false;
+        }
+        off_t position = lseek(m_fd, 0, SEEK_END);
+        if (position < 0) {
+            Logger::error(getClassName(), "Failed to seek file : " + string(strerror(errno)));
+            close();
+            return false;
+        }
+        if (position > 0) {
+            addHeader("Range", "bytes=" + to_string(position) + "-");
+            m_size = position;
+        }
+        resumeHash(position);
+
+        // Data is written in large blocks on the writer thread. curl is paused while all blocks are busy.
+        m_fileWriter = make_shared<FileWriter>(m_fd, m_size);
+        if (!m_fileWriter->open()) {
+            close();
+            return false;
+        }
+        weak_ptr<FileWriter> fileWriter = m_fileWriter;
+        m_fileWriter->setReadyCallback([this, fileWriter] {
+            Util::async([this, fileWriter] {
+                // The writer is released with the transfer
+                if (fileWriter.expired())
+                    return;
+                curl_easy_pause(m_easyHandle, CURLPAUSE_CONT);
+            });
+        });
     }
-    long position = ftell(m_file);
-    if (position > 0) {
-        addHeader("Range", "bytes=" + to_string(position) + "-");
-        m_size = position;
+    m_notifiedSize = m_size;
+    // Don't write error pages into the file
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_FAILONERROR, 1L);
+    if (rc != CURLE_OK) {
+        goto Done;
     }
-    rc1 = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEDATA, this);
-    if (rc1 != CURLE_OK) {
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEDATA, this);
+    if (rc != CURLE_OK) {
         goto Done;
     }
-    rc1 = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEFUNCTION, &HttpFile::onReceiveFileData);
-    if (rc1 != CURLE_OK) {
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEFUNCTION, &HttpFile::onReceiveFileData);
+    if (rc != CURLE_OK) {
         goto Done;
     }
-    glibcurl_set_callback(&HttpFile::onReceiveFileEvent, nullptr);
-    rc2 = glibcurl_add(m_easyHandle);
 
 Done:
-    if (rc1 != CURLE_OK) {
-        Logger::error(getClassName(), "Failed in curl_easy_setopt", curl_easy_strerror(rc1));
+    if (rc != CURLE_OK) {
+        Logger::error(getClassName(), "Failed in curl_easy_setopt", curl_easy_strerror(rc));
         return false;
     }
-    if (rc2 != CURLM_OK) {
-        Logger::error(getClassName(), "Failed in glibcurl_add", curl_multi_strerror(rc2));
+    if (!start()) {
         return false;
     }
-    Logger::verbose(getClassName(), "Downloading is started. Try to call 'onStartedDownload'");
+    BandwidthPolicy::getInstance().add(m_easyHandle);
+    LOG_VERBOSE(getClassName(), "Downloading is started. Try to call 'onStartedDownload'");
     if (m_listener) {
         m_listener->onStartedDownload(this);
     }
     return true;
 }
 
-void HttpFile::onReceiveFileEvent(void* userdata)
+void HttpFile::onFinished(CURLcode result)
 {
-    while (true) {
-        int size;
-        CURLMsg* curlMsg = curl_multi_info_read(glibcurl_handle(), &size);
-        if (curlMsg == nullptr) {
-            break;
-        }
-
-        if (curlMsg->msg != CURLMSG_DONE)  {
-            Logger::warning("HttpFile", "Unknown CURLMsg");
-            continue;
-        }
+    m_result = result;
+    if (!close() && m_result == CURLE_OK) {
+        m_result = result = CURLE_WRITE_ERROR;
+    }
 
-        HttpFile* self = s_map[curlMsg->easy_handle];
-        if (!self) {
-            Logger::error("HttpFile", "HttpCall is null");
-            break;
+    long responseCode = getStatus();
+    if (responseCode == 416L && m_size > 0) {
+        // 'Range Not Satisfiable' : the file was already downloaded completely before resuming
+        Logger::info(getClassName(), "File is already downloaded");
+    } else if (result != CURLE_OK) {
+        Logger::error(getClassName(), "Downloading is failed", string(curl_easy_strerror(result)) + " / " + to_string(responseCode));
+        if (m_listener) {
+            m_listener->onFailedDownload(this);
         }
+        return;
+    }
 
-        glibcurl_remove(self->m_easyHandle);
-
-        Logger::verbose("HttpFile", "Downloading is completed. Try to call 'onCompletedDownload'");
-        self->close();
-        if (self->m_listener) {
-            self->m_listener->onCompletedDownload(self);
-        }
+    LOG_VERBOSE(getClassName(), "Downloading is completed. Try to call 'onCompletedDownload'");
+    if (m_listener) {
+        m_listener->onCompletedDownload(this);
     }
 }
 
@@ -123,21 +189,454 @@ size_t HttpFile::onReceiveFileData(char* ptr, size_t size, size_t nmemb, void* u
         return 0;
     }
 
-    size_t dataSize = fwrite(ptr, size, nmemb, self->m_file);
-    self->m_size += dataSize;
+    size_t dataSize = size * nmemb;
+    if (self->m_writer) {
+        switch (self->m_writer(ptr, dataSize)) {
+        case HttpFileWriteResult_DONE:
+            break;
 
-    if (self->m_listener) {
-        self->m_listener->onProgressDownload(self);
+        case HttpFileWriteResult_BUSY:
+            return CURL_WRITEFUNC_PAUSE;
+
+        case HttpFileWriteResult_FAILED:
+            Logger::error(self->getClassName(), "Failed to write streaming data");
+            return 0;
+        }
+    } else {
+        if (self->m_fileWriter->getError() != 0) {
+            Logger::error(self->getClassName(), "Failed to write file : " + string(strerror(self->m_fileWriter->getError())));
+            return 0;
+        }
+        // curl keeps the data and delivers it again when it is unpaused
+        if (!self->m_fileWriter->write(ptr, dataSize)) {
+            return CURL_WRITEFUNC_PAUSE;
+        }
     }
+    self->m_size += dataSize;
+    self->m_hash.update(ptr, dataSize);
+    BandwidthPolicy::getInstance().onReceived(dataSize);
+    self->notifyProgress();
     return dataSize;
 }
 
-void HttpFile::close()
+void HttpFile::resume()
+{
+    curl_easy_pause(m_easyHandle, CURLPAUSE_CONT);
+}
+
+void HttpFile::notifyProgress()
 {
-    if (m_file) {
-        fflush(m_file);
-        fclose(m_file);
+    // Chunks from curl are small (16KB). Listeners don't need every one of them.
+    if (m_size - m_notifiedSize < PROGRESS_INTERVAL)
+        return;
+
+    m_notifiedSize = m_size;
+    if (m_listener) {
+        m_listener->onProgressDownload(this);
+    }
+}
+
+bool HttpFile::close()
+{
+    bool result = true;
+
+    if (m_fileWriter) {
+        result = m_fileWriter->finish();
+        m_fileWriter = nullptr;
+    }
+    if (m_fd >= 0) {
+        // The hash should match the bytes in the file
+        if (result)
+            saveHash();
+
+        ::close(m_fd);
         m_filename = "";
-        m_file = nullptr;
+        m_fd = -1;
+    }
+    return result;
+}
+
+bool HttpFile::preallocate(bool keepSize)
+{
+    if (m_total == 0)
+        return true;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        Logger::error(getClassName(), "Failed to stat file : " + string(strerror(errno)));
+        return false;
+    }
+    // Reject the file before any bytes are downloaded
+    uint64_t allocated = (uint64_t) st.st_blocks * 512;
+    uint64_t required = (m_total > allocated) ? m_total - allocated : 0;
+    struct statvfs vfs;
+    if (fstatvfs(m_fd, &vfs) == 0 && (uint64_t) vfs.f_bavail * vfs.f_frsize < required) {
+        Logger::error(getClassName(), "Not enough space", to_string(required) + " bytes required, but " + to_string((uint64_t) vfs.f_bavail * vfs.f_frsize) + " bytes available");
+        m_result = CURLE_WRITE_ERROR;
+        return false;
+    }
+    if (required == 0)
+        return true;
+
+    // Contiguous blocks are read faster while installing
+    if (fallocate(m_fd, keepSize ? FALLOC_FL_KEEP_SIZE : 0, 0, m_total) != 0) {
+        if (errno == ENOSPC) {
+            Logger::error(getClassName(), "Not enough space", strerror(errno));
+            m_result = CURLE_WRITE_ERROR;
+            return false;
+        }
+        // i.e. EOPNOTSUPP. The file grows while downloading.
+        LOG_DEBUG(getClassName(), "Failed to preallocate", strerror(errno));
+    }
+    return true;
+}
+
+void HttpFile::resumeHash(uint64_t position)
+{
+    if (m_hash.load(m_filename + HASH_SUFFIX) && m_hash.getSize() == position) {
+        return;
+    }
+
+    // No saved context for the partial file. Hash it once from the beginning.
+    m_hash.reset();
+    if (position == 0) {
+        return;
+    }
+    Logger::info(getClassName(), "Hash is not saved. Read " + to_string(position) + " bytes again");
+    FILE* file = fopen(m_filename.c_str(), "rb");
+    if (file == NULL) {
+        return;
+    }
+    vector<char> buffer(HASH_READ_SIZE);
+    while (m_hash.getSize() < position) {
+        size_t length = fread(buffer.data(), 1, (size_t) min((uint64_t) buffer.size(), position - m_hash.getSize()), file);
+        if (length == 0)
+            break;
+        m_hash.update(buffer.data(), length);
+    }
+    fclose(file);
+}
+
+void HttpFile::advanceHash(uint64_t limit)
+{
+    vector<char> buffer;
+
+    while (limit > 0) {
+        // bytes which are already written right after the hashed ones
+        uint64_t position = m_hash.getSize();
+        uint64_t available = 0;
+        for (auto& segment : m_segments) {
+            if (segment->getBegin() <= position && position < segment->getOffset()) {
+                available = segment->getOffset() - position;
+                break;
+            }
+        }
+        if (available == 0)
+            return;
+
+        if (buffer.empty())
+            buffer.resize(HASH_READ_SIZE);
+        ssize_t length = pread(m_fd, buffer.data(), (size_t) min(min(available, limit), (uint64_t) buffer.size()), position);
+        if (length <= 0) {
+            Logger::error(getClassName(), "Failed to read file : " + string(strerror(errno)));
+            return;
+        }
+        m_hash.update(buffer.data(), length);
+        limit -= length;
+    }
+}
+
+void HttpFile::saveHash()
+{
+    if (m_filename.empty())
+        return;
+
+    if (!m_hash.save(m_filename + HASH_SUFFIX)) {
+        Logger::warning(getClassName(), "Failed to save hash");
+    }
+}
+
+bool HttpFile::sendSegments()
+{
+    m_fd = ::open(m_filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd < 0) {
+        Logger::error(getClassName(), "Failed to open file : " + string(strerror(errno)));
+        return false;
+    }
+    LOG_VERBOSE(getClassName(), "Open file - " + m_filename);
+
+    if (!loadSegments()) {
+        // Start from scratch. Partial data without segment info cannot be trusted.
+        m_segments.clear();
+        m_hash.reset();
+        if (ftruncate(m_fd, 0) != 0 || ftruncate(m_fd, m_total) != 0) {
+            Logger::error(getClassName(), "Failed to resize file : " + string(strerror(errno)));
+            close();
+            return false;
+        }
+        if (!preallocate(false)) {
+            close();
+            return false;
+        }
+        uint64_t length = m_total / m_segmentCount;
+        for (unsigned int i = 0; i < m_segmentCount; i++) {
+            uint64_t begin = i * length;
+            uint64_t end = (i == m_segmentCount - 1) ? m_total - 1 : begin + length - 1;
+            m_segments.push_back(make_shared<HttpFileSegment>(*this, begin, end, begin));
+        }
+        saveSegments();
+    }
+
+    m_size = 0;
+    for (auto& segment : m_segments) {
+        m_size += segment->getOffset() - segment->getBegin();
+    }
+    m_savedSize = m_size;
+    m_notifiedSize = m_size;
+    // The hash is continued from the first byte which is not hashed yet
+    if (!m_hash.load(m_filename + HASH_SUFFIX) || m_hash.getSize() > m_total) {
+        m_hash.reset();
+    }
+    if (m_size == m_total) {
+        // All segments were downloaded before pausing. Let the server confirm it with '416'.
+        string filename = m_filename;
+        m_segments.clear();
+        close();
+        Util::removeFile(filename + SEGMENTS_SUFFIX);
+        m_filename = filename;
+        m_segmentCount = 1;
+        m_size = 0;
+        return send();
+    }
+
+    for (auto& segment : m_segments) {
+        if (segment->isCompleted())
+            continue;
+        if (!segment->send()) {
+            stopSegments();
+            close();
+            return false;
+        }
+    }
+    Logger::info(getClassName(), "Downloading " + to_string(m_segments.size()) + " segments from " + to_string(m_size) + "/" + to_string(m_total));
+    if (m_listener) {
+        m_listener->onStartedDownload(this);
+    }
+    return true;
+}
+
+bool HttpFile::loadSegments()
+{
+    JValue json = JDomParser::fromFile((m_filename + SEGMENTS_SUFFIX).c_str());
+    if (!json.isObject() || !json["segments"].isArray()) {
+        return false;
+    }
+    if (json["total"].asNumber<int64_t>() != (int64_t)m_total) {
+        Logger::warning(getClassName(), "File size is changed. Segments are ignored");
+        return false;
+    }
+
+    m_segments.clear();
+    for (JValue item : json["segments"].items()) {
+        uint64_t begin = item["begin"].asNumber<int64_t>();
+        uint64_t end = item["end"].asNumber<int64_t>();
+        uint64_t offset = item["offset"].asNumber<int64_t>();
+        if (begin > end || end >= m_total || offset < begin || offset > end + 1) {
+            Logger::warning(getClassName(), "Invalid segment. Segments are ignored");
+            return false;
+        }
+        m_segments.push_back(make_shared<HttpFileSegment>(*this, begin, end, offset));
+    }
+    return !m_segments.empty();
+}
+
+void HttpFile::saveSegments()
+{
+    if (m_segments.empty())
+        return;
+
+    JValue json = pbnjson::Object();
+    JValue segments = pbnjson::Array();
+    for (auto& segment : m_segments) {
+        JValue item = pbnjson::Object();
+        item.put("begin", (int64_t)segment->getBegin());
+        item.put("end", (int64_t)segment->getEnd());
+        item.put("offset", (int64_t)segment->getOffset());
+        segments.append(item);
+    }
+    json.put("total", (int64_t)m_total);
+    json.put("segments", segments);
+
+    // Data should be on the disk before its progress is
+    if (m_fd >= 0)
+        fdatasync(m_fd);
+    if (!Util::writeFile(m_filename + SEGMENTS_SUFFIX, json.stringify())) {
+        Logger::warning(getClassName(), "Failed to save segments");
+    }
+    saveHash();
+    m_savedSize = m_size;
+}
+
+void HttpFile::stopSegments()
+{
+    if (m_segments.empty())
+        return;
+
+    // Keep the progress for 'resumeDownload'
+    if (m_fd >= 0)
+        saveSegments();
+    m_segments.clear();
+}
+
+void HttpFile::onReceiveSegmentData(const char* ptr, uint64_t offset, size_t dataSize)
+{
+    m_size += dataSize;
+    BandwidthPolicy::getInstance().onReceived(dataSize);
+    // Bytes right after the hashed ones are hashed directly. Others are read back later.
+    if (offset == m_hash.getSize()) {
+        m_hash.update(ptr, dataSize);
+    }
+    advanceHash(HASH_READ_SIZE);
+    if (m_size - m_savedSize > SEGMENTS_SAVE_INTERVAL) {
+        saveSegments();
+    }
+    notifyProgress();
+}
+
+void HttpFile::onFinishedSegment(HttpFileSegment* segment, CURLcode result)
+{
+    if (m_isRangeUnsupported) {
+        // The server ignored 'Range'. Download the whole file on a single connection.
+        Logger::warning(getClassName(), "Range request is not supported. Fallback to single connection");
+        m_isRangeUnsupported = false;
+        m_segmentCount = 1;
+        string filename = m_filename;
+        m_segments.clear();
+        close();
+        HttpFile::remove(filename);
+        m_filename = filename;
+        m_size = 0;
+        if (!send()) {
+            m_result = CURLE_RANGE_ERROR;
+            if (m_listener) {
+                m_listener->onFailedDownload(this);
+            }
+        }
+        return;
+    }
+
+    if (result != CURLE_OK || !segment->isCompleted()) {
+        Logger::error(getClassName(), "Downloading segment is failed", string(curl_easy_strerror(result)) + " / " + to_string(segment->getBegin()));
+        m_result = (result != CURLE_OK) ? result : CURLE_PARTIAL_FILE;
+        stopSegments();
+        close();
+        if (m_listener) {
+            m_listener->onFailedDownload(this);
+        }
+        return;
+    }
+
+    for (auto& segment : m_segments) {
+        if (!segment->isCompleted())
+            return;
     }
+
+    LOG_VERBOSE(getClassName(), "Downloading is completed. Try to call 'onCompletedDownload'");
+    advanceHash(m_total);
+    string filename = m_filename;
+    m_segments.clear();
+    close();
+    Util::removeFile(filename + SEGMENTS_SUFFIX);
+    m_result = CURLE_OK;
+    if (m_listener) {
+        m_listener->onCompletedDownload(this);
+    }
+}
+
+HttpFileSegment::HttpFileSegment(HttpFile& parent, uint64_t begin, uint64_t end, uint64_t offset)
+    : HttpRequest()
+    , m_parent(parent)
+    , m_begin(begin)
+    , m_end(end)
+    , m_offset(offset)
+{
+    setClassName("HttpFileSegment");
+}
+
+HttpFileSegment::~HttpFileSegment()
+{
+    stop();
+}
+
+bool HttpFileSegment::send(JValue request)
+{
+    CURLcode rc;
+    string range = to_string(m_offset) + "-" + to_string(m_end);
+
+    if (!open(MethodType_GET, m_parent.getUrl()) || !prepare()) {
+        return false;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_RANGE, range.c_str());
+    if (rc != CURLE_OK) {
+        goto Done;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_FAILONERROR, 1L);
+    if (rc != CURLE_OK) {
+        goto Done;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEDATA, this);
+    if (rc != CURLE_OK) {
+        goto Done;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEFUNCTION, &HttpFileSegment::onReceiveSegmentData);
+    if (rc != CURLE_OK) {
+        goto Done;
+    }
+
+Done:
+    if (rc != CURLE_OK) {
+        Logger::error(getClassName(), "Failed in curl_easy_setopt", curl_easy_strerror(rc));
+        return false;
+    }
+    LOG_VERBOSE(getClassName(), "Range - " + range);
+    if (!start()) {
+        return false;
+    }
+    BandwidthPolicy::getInstance().add(m_easyHandle);
+    return true;
+}
+
+void HttpFileSegment::onFinished(CURLcode result)
+{
+    m_result = result;
+    // 'this' can be released in 'onFinishedSegment'
+    m_parent.onFinishedSegment(this, result);
+}
+
+size_t HttpFileSegment::onReceiveSegmentData(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    HttpFileSegment* self = (HttpFileSegment*)userdata;
+    if (!self) {
+        Logger::error("HttpFileSegment", "userdata is null");
+        return 0;
+    }
+
+    // '200 OK' means the server sends the whole file instead of the range
+    if (self->getStatus() != 206L) {
+        self->m_parent.m_isRangeUnsupported = true;
+        return 0;
+    }
+
+    size_t dataSize = size * nmemb;
+    if (self->m_offset + dataSize > self->m_end + 1) {
+        Logger::error(self->getClassName(), "Received data exceeds the range");
+        return 0;
+    }
+    if (pwrite(self->m_parent.m_fd, ptr, dataSize, self->m_offset) != (ssize_t)dataSize) {
+        Logger::error(self->getClassName(), "Failed to write file : " + string(strerror(errno)));
+        return 0;
+    }
+    self->m_offset += dataSize;
+    self->m_parent.onReceiveSegmentData(ptr, self->m_offset - dataSize, dataSize);
+    return dataSize;
 }
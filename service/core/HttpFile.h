@@ -18,12 +18,18 @@
 #define CORE_HTTPFILE_H_
 
 #include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <vector>
 
 #include "core/HttpRequest.h"
+#include "util/HashContext.h"
 
 using namespace std;
 
+class FileWriter;
 class HttpFile;
+class HttpFileSegment;
 
 class HttpFileListener {
 public:
@@ -37,40 +43,160 @@ public:
 
 };
 
+enum HttpFileWriteResult {
+    HttpFileWriteResult_DONE,
+    // The transfer is paused until 'HttpFile::resume'. The same data comes again after that.
+    HttpFileWriteResult_BUSY,
+    // The download is aborted
+    HttpFileWriteResult_FAILED,
+};
+
+// Consumer of the downloaded data instead of the file
+typedef function<HttpFileWriteResult(const char* data, size_t size)> HttpFileWriter;
+
 class HttpFile : public HttpRequest,
                  public IListener<HttpFileListener> {
+friend class HttpFileSegment;
 public:
+    // Remove the downloaded file and its sidecar files
+    static bool remove(const string& filename);
+    // Load the hash of the downloaded file. It fails if the hash doesn't cover the whole file.
+    static bool loadHash(const string& filename, HashContext& hash);
+
     HttpFile();
     virtual ~HttpFile();
 
     virtual bool send(JValue request = nullptr) override;
+    // Continue the transfer paused by 'HttpFileWriter'. It should be called on the main loop.
+    void resume();
+
+    // Download the file with 'count' parallel range requests. 'total' should be the exact file size.
+    // Progress of each range is saved next to the file, so resuming downloads only the missing bytes.
+    void setSegments(unsigned int count, uint64_t total)
+    {
+        m_segmentCount = count;
+        m_total = total;
+    }
+
+    // Expected size of the file. Free space is checked and the file is preallocated before downloading.
+    void setTotal(uint64_t total)
+    {
+        m_total = total;
+    }
 
     void setFilename(const string& filename)
     {
         m_filename = filename;
     }
 
+    // Stream the data to 'writer' without saving it. It cannot be resumed, so it always starts from the beginning.
+    void setWriter(HttpFileWriter writer)
+    {
+        m_writer = writer;
+    }
+
     const string& getFilename()
     {
         return m_filename;
     }
 
-    size_t getFilesize()
+    uint64_t getFilesize()
     {
         return m_size;
     }
 
+    // Hash of the bytes downloaded so far. It is updated while downloading.
+    HashContext& getHash()
+    {
+        return m_hash;
+    }
+
+protected:
+    // HttpRequest
+    virtual void onFinished(CURLcode result) override;
+
 private:
+    static const string SEGMENTS_SUFFIX;
+    static const size_t SEGMENTS_SAVE_INTERVAL = 8 * 1024 * 1024;
+    static const string HASH_SUFFIX;
+    static const size_t HASH_READ_SIZE = 256 * 1024;
+    static const size_t PROGRESS_INTERVAL = 256 * 1024;
+
     static size_t onReceiveFileData(char* ptr, size_t size, size_t nmemb, void* userdata);
-    static void onReceiveFileEvent(void* userdata);
 
-    void close();
+    void notifyProgress();
+    // Returns false if the buffered data couldn't be written
+    bool close();
+    bool preallocate(bool keepSize);
 
-    static map<CURL*, HttpFile*> s_map;
+    void resumeHash(uint64_t position);
+    void advanceHash(uint64_t limit);
+    void saveHash();
+
+    bool sendSegments();
+    bool loadSegments();
+    void saveSegments();
+    void stopSegments();
+    void onReceiveSegmentData(const char* ptr, uint64_t offset, size_t dataSize);
+    void onFinishedSegment(HttpFileSegment* segment, CURLcode result);
 
     string m_filename;
-    FILE* m_file;
-    size_t m_size;
+    // Files can be larger than 4GB. (size_t is 32 bits on some targets)
+    uint64_t m_size;
+    uint64_t m_notifiedSize;
+    HashContext m_hash;
+    HttpFileWriter m_writer;
+    shared_ptr<FileWriter> m_fileWriter;
+
+    // segmented download
+    unsigned int m_segmentCount;
+    uint64_t m_total;
+    uint64_t m_savedSize;
+    int m_fd;
+    bool m_isRangeUnsupported;
+    vector<shared_ptr<HttpFileSegment>> m_segments;
+};
+
+// A byte range [begin, end] of HttpFile downloaded on its own connection
+class HttpFileSegment : public HttpRequest {
+public:
+    HttpFileSegment(HttpFile& parent, uint64_t begin, uint64_t end, uint64_t offset);
+    virtual ~HttpFileSegment();
+
+    virtual bool send(JValue request = nullptr) override;
+
+    uint64_t getBegin()
+    {
+        return m_begin;
+    }
+
+    uint64_t getEnd()
+    {
+        return m_end;
+    }
+
+    // next position to be written
+    uint64_t getOffset()
+    {
+        return m_offset;
+    }
+
+    bool isCompleted()
+    {
+        return m_offset > m_end;
+    }
+
+protected:
+    // HttpRequest
+    virtual void onFinished(CURLcode result) override;
+
+private:
+    static size_t onReceiveSegmentData(char* ptr, size_t size, size_t nmemb, void* userdata);
+
+    HttpFile& m_parent;
+    uint64_t m_begin;
+    uint64_t m_end;
+    uint64_t m_offset;
 };
 
 #endif /* CORE_HTTPFILE_H_ */
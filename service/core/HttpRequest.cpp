@@ -16,12 +16,14 @@
 
 #include "core/HttpRequest.h"
 
+#include "core/BandwidthPolicy.h"
 #include "hawkbit/HawkBitInfo.h"
 
 string HttpRequest::toString(long responseCode)
 {
     switch(responseCode) {
     case 200L:  return "Ok";
+    case 304L:  return "Not Modified";
     case 400L:  return "Bad Request";
     case 401L:  return "Unauthorized";
     case 403L:  return "Forbidden";
@@ -39,10 +41,12 @@ HttpRequest::HttpRequest()
     , m_header(NULL)
     , m_requestText("")
     , m_responseText("")
+    , m_result(CURLE_OK)
+    , m_isRunning(false)
 {
     setClassName("HttpCall");
 
-    m_easyHandle = curl_easy_init();
+    m_easyHandle = CurlLoop::getInstance().acquireHandle();
 
     addHeader("Accept", "application/hal+json");
     addHeader("Content-Type", "application/json;charset=UTF-8");
@@ -51,8 +55,9 @@ HttpRequest::HttpRequest()
 
 HttpRequest::~HttpRequest()
 {
+    stop();
     if (m_easyHandle)
-        curl_easy_cleanup(m_easyHandle);
+        CurlLoop::getInstance().releaseHandle(m_easyHandle);
     if (m_header)
         curl_slist_free_all(m_header);
 }
@@ -61,7 +66,7 @@ bool HttpRequest::open(const MethodType& methodType, const std::string& url)
 {
     if (!setMethod(methodType) || !setUrl(url))
         return false;
-    Logger::verbose(getClassName(), __FUNCTION__);
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
     return true;
 }
 
@@ -86,12 +91,70 @@ bool HttpRequest::send(JValue request)
     if (rc != CURLE_OK) {
         goto Error;
     }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_HEADERDATA, this);
+    if (rc != CURLE_OK) {
+        goto Error;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_HEADERFUNCTION, &HttpRequest::onReceiveHeader);
+    if (rc != CURLE_OK) {
+        goto Error;
+    }
+    m_responseHeaders.clear();
     rc = curl_easy_perform(m_easyHandle);
     if (rc != CURLE_OK) {
         goto Error;
     }
 
-    Logger::verbose(getClassName(), __FUNCTION__);
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
+    return true;
+
+Error:
+    Logger::error(getClassName(), "Failed in curl_easy_setopt", curl_easy_strerror(rc));
+    return false;
+}
+
+bool HttpRequest::sendAsync(HttpRequestCallback callback, JValue request)
+{
+    if (m_type == MethodType_NONE || m_easyHandle == nullptr) {
+        return false;
+    }
+    if (m_isRunning) {
+        Logger::error(getClassName(), "Request is already running");
+        return false;
+    }
+    if (!request.isNull() && request.isValid()) {
+        m_requestText = request.stringify();
+    }
+    if (!prepare()) {
+        return false;
+    }
+
+    CURLcode rc = CURLE_OK;
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEDATA, this);
+    if (rc != CURLE_OK) {
+        goto Error;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_WRITEFUNCTION, &HttpRequest::onReceiveResponse);
+    if (rc != CURLE_OK) {
+        goto Error;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_HEADERDATA, this);
+    if (rc != CURLE_OK) {
+        goto Error;
+    }
+    rc = curl_easy_setopt(m_easyHandle, CURLOPT_HEADERFUNCTION, &HttpRequest::onReceiveHeader);
+    if (rc != CURLE_OK) {
+        goto Error;
+    }
+
+    m_responseText = "";
+    m_responseHeaders.clear();
+    m_callback = callback;
+    if (!start()) {
+        m_callback = nullptr;
+        return false;
+    }
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
     return true;
 
 Error:
@@ -103,15 +166,93 @@ size_t HttpRequest::onReceiveResponse(char* ptr, size_t size, size_t nmemb, void
 {
     HttpRequest* self = static_cast<HttpRequest*>(userdata);
     if (!self) {
-        Logger::error(self->getClassName(), "userdata is null");
+        Logger::error("HttpCall", "userdata is null");
         return 0;
     }
 
     size_t dataSize = size * nmemb;
-    self->m_responseText.append(ptr);
+    self->m_responseText.append(ptr, dataSize);
+    return dataSize;
+}
+
+size_t HttpRequest::onReceiveHeader(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    HttpRequest* self = static_cast<HttpRequest*>(userdata);
+    if (!self) {
+        Logger::error("HttpCall", "userdata is null");
+        return 0;
+    }
+
+    size_t dataSize = size * nitems;
+    string line(buffer, dataSize);
+    // Each response (i.e. after redirection) starts with its status line
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        self->m_responseHeaders.clear();
+        return dataSize;
+    }
+
+    size_t colon = line.find(':');
+    if (colon == string::npos) {
+        return dataSize;
+    }
+    string key = line.substr(0, colon);
+    transform(key.begin(), key.end(), key.begin(), ::tolower);
+    size_t begin = line.find_first_not_of(" \t", colon + 1);
+    size_t end = line.find_last_not_of(" \t\r\n");
+    self->m_responseHeaders[key] = (begin == string::npos || end < begin) ? "" : line.substr(begin, end - begin + 1);
     return dataSize;
 }
 
+void HttpRequest::setCacheValidators(const string& etag, const string& lastModified)
+{
+    if (!etag.empty())
+        addHeader("If-None-Match", etag);
+    if (!lastModified.empty())
+        addHeader("If-Modified-Since", lastModified);
+}
+
+void HttpRequest::onFinishedTransfer(CURLcode result)
+{
+    // 'this' can be deleted in 'onFinished'. Don't touch it after the call.
+    stop();
+    onFinished(result);
+}
+
+void HttpRequest::onFinished(CURLcode result)
+{
+    m_result = result;
+    if (result != CURLE_OK) {
+        Logger::error(getClassName(), "Failed to perform request", curl_easy_strerror(result));
+    }
+
+    // The owner of this request usually releases it in callback
+    HttpRequestCallback callback = m_callback;
+    m_callback = nullptr;
+    if (callback) {
+        callback(this);
+    }
+}
+
+bool HttpRequest::start()
+{
+    if (!CurlLoop::getInstance().add(m_easyHandle, this)) {
+        return false;
+    }
+    m_result = CURLE_OK;
+    m_isRunning = true;
+    return true;
+}
+
+void HttpRequest::stop()
+{
+    if (!m_isRunning) {
+        return;
+    }
+    CurlLoop::getInstance().remove(m_easyHandle);
+    BandwidthPolicy::getInstance().remove(m_easyHandle);
+    m_isRunning = false;
+}
+
 bool HttpRequest::prepare()
 {
     CURLcode rc = CURLE_OK;
@@ -18,12 +18,14 @@
 #define CORE_HTTPREQUEST_H_
 
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <sstream>
 #include <string>
 #include <curl/curl.h>
 #include <pbnjson.hpp>
 
+#include "core/CurlLoop.h"
 #include "interface/IClassName.h"
 #include "interface/IListener.h"
 #include "util/Logger.h"
@@ -39,7 +41,13 @@ enum MethodType {
     MethodType_DELETE,
 };
 
-class HttpRequest : public IClassName {
+class HttpRequest;
+
+// Invoked on the main loop when an asynchronous request is finished (successfully or not)
+typedef function<void(HttpRequest* request)> HttpRequestCallback;
+
+class HttpRequest : public IClassName,
+                    public CurlLoopListener {
 public:
     static string toString(long responseCode);
 
@@ -48,6 +56,19 @@ public:
 
     virtual bool open(const MethodType& methodType, const std::string& url);
     virtual bool send(JValue request = nullptr);
+    // Register the request on the CurlLoop multi handle and return immediately.
+    // 'callback' is called once the transfer is finished. Check 'getResult' and 'getStatus' in it.
+    virtual bool sendAsync(HttpRequestCallback callback, JValue request = nullptr);
+
+    CURLcode getResult()
+    {
+        return m_result;
+    }
+
+    bool isRunning()
+    {
+        return m_isRunning;
+    }
 
     long getStatus()
     {
@@ -65,9 +86,34 @@ public:
         return m_responseText;
     }
 
+    // Header of the final response. 'key' is lowercase. (i.e. "etag")
+    string getResponseHeader(const string& key)
+    {
+        auto it = m_responseHeaders.find(key);
+        return (it != m_responseHeaders.end()) ? it->second : "";
+    }
+
+    // Validators of the cached response. The server answers '304 Not Modified' if it is not changed.
+    // It should be called before sending.
+    void setCacheValidators(const string& etag, const string& lastModified);
+
+    const string& getUrl()
+    {
+        return m_url;
+    }
+
+    // CurlLoopListener
+    virtual void onFinishedTransfer(CURLcode result) override;
+
 protected:
     static size_t onReceiveResponse(char* contents, size_t size, size_t nmemb, void* userdata);
+    static size_t onReceiveHeader(char* buffer, size_t size, size_t nitems, void* userdata);
 
+    // Called when the transfer registered by 'start' is finished
+    virtual void onFinished(CURLcode result);
+
+    bool start();
+    void stop();
     bool prepare();
     void addHeader(const std::string& key, const std::string& val);
     bool setUrl(const std::string& url);
@@ -80,6 +126,12 @@ protected:
     string m_url;
     string m_requestText;
     string m_responseText;
+    map<string, string> m_responseHeaders;
+
+    // async
+    CURLcode m_result;
+    bool m_isRunning;
+    HttpRequestCallback m_callback;
 
 };
 
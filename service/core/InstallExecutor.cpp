@@ -0,0 +1,88 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "core/InstallExecutor.h"
+
+#include "util/Logger.h"
+#include "util/Util.h"
+
+InstallExecutor::InstallExecutor()
+    : m_isStopping(false)
+{
+    setClassName("InstallExecutor");
+}
+
+InstallExecutor::~InstallExecutor()
+{
+}
+
+bool InstallExecutor::onInitialization()
+{
+    m_isStopping = false;
+    for (int i = 0; i < WORKER_COUNT; i++) {
+        m_workers.push_back(thread(&InstallExecutor::run, this));
+    }
+    return true;
+}
+
+bool InstallExecutor::onFinalization()
+{
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_isStopping = true;
+        m_works.clear();
+        m_condition.notify_all();
+    }
+    // Running work (i.e. writing partition) is not interrupted
+    for (thread& worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+    return true;
+}
+
+bool InstallExecutor::execute(Work work, Callback callback)
+{
+    unique_lock<mutex> lock(m_mutex);
+    if (m_isStopping || m_workers.empty()) {
+        Logger::error(getClassName(), __FUNCTION__, "Executor is not running");
+        return false;
+    }
+    m_works.push_back(make_pair(work, callback));
+    m_condition.notify_one();
+    return true;
+}
+
+void InstallExecutor::run()
+{
+    while (true) {
+        unique_lock<mutex> lock(m_mutex);
+        m_condition.wait(lock, [this] { return m_isStopping || !m_works.empty(); });
+        if (m_isStopping)
+            return;
+        pair<Work, Callback> work = m_works.front();
+        m_works.pop_front();
+        lock.unlock();
+
+        bool result = work.first();
+        // g_timeout_add is thread-safe. The callback runs on the main loop.
+        Callback callback = work.second;
+        Util::async([callback, result] {
+            if (callback)
+                callback(result);
+        });
+    }
+}
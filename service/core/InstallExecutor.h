@@ -0,0 +1,66 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CORE_INSTALLEXECUTOR_H_
+#define CORE_INSTALLEXECUTOR_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "interface/IInitializable.h"
+#include "interface/ISingleton.h"
+
+using namespace std;
+
+// Runs long install works (verification, deploy, opkg) out of the main loop.
+// Luna requests like '/getStatus' and '/cancelInstall' are handled while installing.
+class InstallExecutor : public IInitializable,
+                        public ISingleton<InstallExecutor> {
+friend class ISingleton<InstallExecutor>;
+public:
+    // 'Work' runs on a worker thread. It should not touch objects owned by the main loop.
+    typedef function<bool()> Work;
+    // 'Callback' is called on the main loop with the result of 'Work'
+    typedef function<void(bool result)> Callback;
+
+    virtual ~InstallExecutor();
+
+    // IInitializable
+    virtual bool onInitialization() override;
+    virtual bool onFinalization() override;
+
+    bool execute(Work work, Callback callback);
+
+private:
+    static const int WORKER_COUNT = 2;
+
+    InstallExecutor();
+
+    void run();
+
+    vector<thread> m_workers;
+    deque<pair<Work, Callback>> m_works;
+    mutex m_mutex;
+    condition_variable m_condition;
+    bool m_isStopping;
+};
+
+#endif /* CORE_INSTALLEXECUTOR_H_ */
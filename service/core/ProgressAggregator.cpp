@@ -0,0 +1,73 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "core/ProgressAggregator.h"
+
+ProgressAggregator::ProgressAggregator(PostCallback callback)
+    : m_callback(callback)
+    , m_interval(1000)
+    , m_lastPost(0)
+    , m_timerSrc(0)
+{
+    setClassName("ProgressAggregator");
+}
+
+ProgressAggregator::~ProgressAggregator()
+{
+    if (m_timerSrc != 0) {
+        g_source_remove(m_timerSrc);
+        m_timerSrc = 0;
+    }
+}
+
+void ProgressAggregator::update()
+{
+    // Merged into the pending post
+    if (m_timerSrc != 0)
+        return;
+
+    gint64 elapsed = (g_get_monotonic_time() - m_lastPost) / 1000;
+    if (m_lastPost == 0 || elapsed >= (gint64) m_interval) {
+        post();
+        return;
+    }
+    m_timerSrc = g_timeout_add(m_interval - (guint) elapsed, onTimeout, this);
+}
+
+void ProgressAggregator::flush()
+{
+    if (m_timerSrc != 0) {
+        g_source_remove(m_timerSrc);
+        m_timerSrc = 0;
+    }
+    post();
+}
+
+gboolean ProgressAggregator::onTimeout(gpointer data)
+{
+    ProgressAggregator* self = (ProgressAggregator*) data;
+    self->m_timerSrc = 0;
+    self->post();
+    return G_SOURCE_REMOVE;
+}
+
+void ProgressAggregator::post()
+{
+    m_lastPost = g_get_monotonic_time();
+    if (m_callback)
+        m_callback();
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef CORE_PROGRESSAGGREGATOR_H_
+#define CORE_PROGRESSAGGREGATOR_H_
+
+#include <functional>
+#include <iostream>
+#include <glib.h>
+
+#include "interface/IClassName.h"
+
+using namespace std;
+
+// Coalesces frequent progress updates into one post per interval.
+// The first update after a quiet interval is posted at once, and the others are merged into a single trailing post.
+// State transitions should call 'flush', so they are never delayed.
+class ProgressAggregator : public IClassName {
+public:
+    typedef function<void()> PostCallback;
+
+    ProgressAggregator(PostCallback callback);
+    virtual ~ProgressAggregator();
+
+    // minimum milliseconds between posts
+    void setInterval(unsigned int interval)
+    {
+        m_interval = interval;
+    }
+
+    // Progress is changed. It is posted now or at the end of the interval.
+    void update();
+    // Post now. Pending progress is included.
+    void flush();
+
+private:
+    static gboolean onTimeout(gpointer data);
+
+    void post();
+
+    PostCallback m_callback;
+    unsigned int m_interval;
+    // monotonic time of the last post in microseconds
+    gint64 m_lastPost;
+    guint m_timerSrc;
+};
+
+#endif /* CORE_PROGRESSAGGREGATOR_H_ */
@@ -0,0 +1,128 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "core/StreamWriter.h"
+
+#include "util/Logger.h"
+
+StreamWriter::StreamWriter(shared_ptr<AbsUpdateStream> stream)
+    : m_stream(stream)
+    , m_readyCallback(nullptr)
+    , m_queuedSize(0)
+    , m_isFinished(false)
+    , m_isStopping(false)
+    , m_isStalled(false)
+    , m_isFailed(false)
+{
+    setClassName("StreamWriter");
+}
+
+StreamWriter::~StreamWriter()
+{
+    // Canceled. The queued data is dropped.
+    stop();
+}
+
+bool StreamWriter::open()
+{
+    if (!m_stream)
+        return false;
+
+    m_thread = thread(&StreamWriter::run, this);
+    return true;
+}
+
+bool StreamWriter::write(const char* data, size_t size)
+{
+    if (m_isFailed || m_isFinished)
+        return false;
+
+    unique_lock<mutex> lock(m_mutex);
+    // A chunk larger than the limit is taken when the queue is empty
+    if (m_queuedSize > 0 && m_queuedSize + size > MAX_QUEUED_SIZE) {
+        m_isStalled = true;
+        return false;
+    }
+    m_chunks.emplace_back(data, data + size);
+    m_queuedSize += size;
+    m_condition.notify_all();
+    return true;
+}
+
+bool StreamWriter::finish(DeployResult& result)
+{
+    {
+        unique_lock<mutex> lock(m_mutex);
+        if (m_isFinished)
+            return false;
+        m_isFinished = true;
+        m_condition.notify_all();
+    }
+    // The worker exits when the queue is drained
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // A failed stream doesn't write anything more, but it fills the result
+    bool isFinished = m_stream->finish(result);
+    return !m_isFailed && isFinished;
+}
+
+void StreamWriter::run()
+{
+    unique_lock<mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this] { return !m_chunks.empty() || m_isFinished || m_isStopping; });
+        if (m_isStopping || m_chunks.empty())
+            break;
+
+        vector<char> chunk;
+        chunk.swap(m_chunks.front());
+        m_chunks.pop_front();
+        lock.unlock();
+        bool result = !m_isFailed && m_stream->write(chunk.data(), chunk.size());
+        lock.lock();
+
+        m_queuedSize -= chunk.size();
+        if (!result && !m_isFailed) {
+            Logger::error(getClassName(), __FUNCTION__, "Failed to write stream");
+            m_isFailed = true;
+        }
+        // The caller waits for room (or for the failure to abort)
+        if (m_isStalled || !result) {
+            m_isStalled = false;
+            if (m_readyCallback) {
+                lock.unlock();
+                m_readyCallback();
+                lock.lock();
+            }
+        }
+        if (!result)
+            break;
+    }
+}
+
+void StreamWriter::stop()
+{
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_isStopping = true;
+        m_chunks.clear();
+        m_queuedSize = 0;
+        m_condition.notify_all();
+    }
+    if (m_thread.joinable())
+        m_thread.join();
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CORE_STREAMWRITER_H_
+#define CORE_STREAMWRITER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "interface/IClassName.h"
+#include "updater/AbsUpdater.h"
+
+using namespace std;
+
+// Feeds an AbsUpdateStream on a worker thread, so decompression and partition writes don't block the main loop.
+// 'write' never waits: it refuses the data while the queue is full,
+// and the ready callback is called once there is room again.
+class StreamWriter : public IClassName {
+public:
+    // Called on the worker thread
+    typedef function<void()> ReadyCallback;
+
+    StreamWriter(shared_ptr<AbsUpdateStream> stream);
+    virtual ~StreamWriter();
+
+    bool open();
+    // Returns false without taking any data if the queue is full (or on failure. see 'isFailed')
+    bool write(const char* data, size_t size);
+    // Write the queued data and finish the stream. It blocks until the worker is done.
+    bool finish(DeployResult& result);
+
+    void setReadyCallback(ReadyCallback callback)
+    {
+        m_readyCallback = callback;
+    }
+
+    bool isFailed()
+    {
+        return m_isFailed;
+    }
+
+private:
+    static const size_t MAX_QUEUED_SIZE = 4 * 1024 * 1024;
+
+    void run();
+    void stop();
+
+    shared_ptr<AbsUpdateStream> m_stream;
+    ReadyCallback m_readyCallback;
+
+    deque<vector<char>> m_chunks;
+    size_t m_queuedSize;
+    bool m_isFinished;
+
+    thread m_thread;
+    mutex m_mutex;
+    condition_variable m_condition;
+    bool m_isStopping;
+    bool m_isStalled;
+    atomic<bool> m_isFailed;
+};
+
+#endif /* CORE_STREAMWRITER_H_ */
@@ -19,6 +19,8 @@
 
 Composite::Composite()
     : m_current(-1)
+    , m_isDirty(true)
+    , m_cachedJson(nullptr)
 {
     m_children.clear();
 }
@@ -27,3 +29,114 @@ Composite::~Composite()
 {
     m_children.clear();
 }
+
+JValue Composite::toCachedJson()
+{
+    if (isDirty() || !m_cachedJson.isObject()) {
+        JValue json = pbnjson::Object();
+        toJson(json);
+        m_cachedJson = json;
+        m_isDirty = false;
+    }
+    return m_cachedJson;
+}
+
+JValue Composite::toDeltaJson()
+{
+    JValue delta = pbnjson::Object();
+    JValue children = pbnjson::Array();
+    bool isChildChanged = false;
+    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
+        if ((*it)->isDirty()) {
+            children.append((*it)->toDeltaJson());
+            isChildChanged = true;
+        } else {
+            children.append(pbnjson::Object());
+        }
+    }
+
+    // Caches of the children are fresh now. Only this node is serialized again.
+    bool isChanged = m_isDirty;
+    if (isChanged || isChildChanged) {
+        JValue json = pbnjson::Object();
+        toJson(json);
+        m_cachedJson = json;
+        m_isDirty = false;
+    }
+    if (isChanged) {
+        string childrenKey = getChildrenKey();
+        for (auto it : m_cachedJson.children()) {
+            if (it.first.asString() != childrenKey)
+                delta.put(it.first.asString(), it.second);
+        }
+    }
+    if (isChildChanged)
+        delta.put(getChildrenKey(), children);
+    return delta;
+}
+
+bool Composite::isDirty()
+{
+    if (m_isDirty)
+        return true;
+    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
+        if ((*it)->isDirty())
+            return true;
+    }
+    return false;
+}
+
+bool Composite::startChildrenDownload(unsigned int first)
+{
+    m_downloaded.clear();
+    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
+        if ((unsigned int) (it - m_children.begin()) < first) {
+            m_downloaded.insert(it->get());
+            continue;
+        }
+        if (!(*it)->startDownload()) {
+            pauseChildrenDownload(it->get());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Composite::pauseChildrenDownload(Composite* except)
+{
+    bool result = true;
+    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
+        if (it->get() == except || m_downloaded.count(it->get()) != 0)
+            continue;
+        if (!(*it)->pauseDownload())
+            result = false;
+    }
+    return result;
+}
+
+bool Composite::resumeChildrenDownload()
+{
+    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
+        if (m_downloaded.count(it->get()) != 0)
+            continue;
+        if (!(*it)->resumeDownload()) {
+            pauseChildrenDownload(it->get());
+            return false;
+        }
+    }
+    return true;
+}
+
+void Composite::cancelChildrenDownload()
+{
+    m_downloaded.clear();
+    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
+        (void) (*it)->cancelDownload();
+    }
+}
+
+bool Composite::completeChildDownload(Composite* child)
+{
+    m_downloaded.insert(child);
+    return m_downloaded.size() >= m_children.size();
+}
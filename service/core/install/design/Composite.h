@@ -20,6 +20,8 @@
 
 #include <iostream>
 #include <deque>
+#include <memory>
+#include <set>
 
 #include "interface/ISerializable.h"
 
@@ -33,6 +35,8 @@ public:
     virtual ~CompositeListener() {}
 
     virtual void onChangedStatus(Composite* composite) = 0;
+    // Only the progress is changed. Listeners may coalesce it.
+    virtual void onChangedProgress(Composite* composite) = 0;
     virtual void onCompletedDownload(Composite* composite) = 0;
     virtual void onCompletedInstall(Composite* composite) = 0;
     virtual void onFailedDownload(Composite* composite) = 0;
@@ -56,11 +60,47 @@ public:
         return true;
     }
 
+    // Serialized fragment of this node. It is serialized again only if this node or its children are dirty.
+    // The fragment is shared with the cache, so it should not be modified.
+    JValue toCachedJson();
+    // true if this node or any of its children is changed since the last 'toCachedJson'
+    bool isDirty();
+    // Fields changed since the last 'toCachedJson' or 'toDeltaJson'. Only dirty nodes are visited.
+    // The children array has an entry per child, and it is an empty object for unchanged ones.
+    JValue toDeltaJson();
+
 protected:
+    // Key of the children array in 'toJson'
+    virtual string getChildrenKey()
+    {
+        return "children";
+    }
+
+    // Fields in 'toJson' are changed
+    void setDirty()
+    {
+        m_isDirty = true;
+    }
+
+    // Children are downloaded at once. DownloadScheduler limits the number of running artifacts.
+    // Children before 'first' are regarded as downloaded. (i.e. installed already)
+    bool startChildrenDownload(unsigned int first = 0);
+    bool pauseChildrenDownload(Composite* except = nullptr);
+    bool resumeChildrenDownload();
+    void cancelChildrenDownload();
+    // returns true if all children are downloaded
+    bool completeChildDownload(Composite* child);
+
     deque<shared_ptr<Composite>> m_children;
 
+    // children whose download is completed
+    set<Composite*> m_downloaded;
+    // child being installed. Install is still done one by one.
     unsigned int m_current;
 
+    bool m_isDirty;
+    JValue m_cachedJson;
+
 };
 
 #endif /* CORE_INSTALL_DESIGN_COMPOSITE_H_ */
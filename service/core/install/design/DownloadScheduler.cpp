@@ -0,0 +1,85 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "core/install/design/DownloadScheduler.h"
+
+#include <algorithm>
+
+#include "Setting.h"
+#include "util/Logger.h"
+#include "util/Util.h"
+
+DownloadScheduler::DownloadScheduler()
+    : m_isScheduled(false)
+{
+    setClassName("DownloadScheduler");
+}
+
+DownloadScheduler::~DownloadScheduler()
+{
+}
+
+bool DownloadScheduler::request(DownloadSchedulerListener* listener)
+{
+    if (m_running.find(listener) != m_running.end() ||
+        find(m_waiting.begin(), m_waiting.end(), listener) != m_waiting.end()) {
+        return true;
+    }
+
+    if (m_running.size() >= Setting::getInstance().getMaxDownloads()) {
+        LOG_DEBUG(getClassName(), __FUNCTION__, "Wait for a slot (" + to_string(m_waiting.size() + 1) + " waiting)");
+        m_waiting.push_back(listener);
+        return true;
+    }
+
+    m_running.insert(listener);
+    if (!listener->onStartDownload()) {
+        m_running.erase(listener);
+        return false;
+    }
+    return true;
+}
+
+void DownloadScheduler::release(DownloadSchedulerListener* listener)
+{
+    m_waiting.erase(remove(m_waiting.begin(), m_waiting.end(), listener), m_waiting.end());
+    if (m_running.erase(listener) == 0)
+        return;
+    if (m_waiting.empty() || m_isScheduled)
+        return;
+
+    // The caller is usually in the middle of HttpFile or composite callbacks.
+    // Start next downloads after those are returned.
+    m_isScheduled = true;
+    Util::async([this] {
+        m_isScheduled = false;
+        startNext();
+    });
+}
+
+void DownloadScheduler::startNext()
+{
+    while (!m_waiting.empty() && m_running.size() < Setting::getInstance().getMaxDownloads()) {
+        DownloadSchedulerListener* listener = m_waiting.front();
+        m_waiting.pop_front();
+        m_running.insert(listener);
+        if (!listener->onStartDownload()) {
+            m_running.erase(listener);
+            listener->onFailedStartDownload();
+        }
+    }
+}
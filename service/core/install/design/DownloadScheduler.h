@@ -0,0 +1,64 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef CORE_INSTALL_DESIGN_DOWNLOADSCHEDULER_H_
+#define CORE_INSTALL_DESIGN_DOWNLOADSCHEDULER_H_
+
+#include <iostream>
+#include <deque>
+#include <set>
+
+#include "interface/IClassName.h"
+#include "interface/ISingleton.h"
+
+using namespace std;
+
+class DownloadSchedulerListener {
+public:
+    DownloadSchedulerListener() {}
+    virtual ~DownloadSchedulerListener() {}
+
+    // A download slot is assigned. Returns false if the download can't be started.
+    virtual bool onStartDownload() = 0;
+    // The download waited in the queue, but failed to start.
+    virtual void onFailedStartDownload() = 0;
+};
+
+// Limits the number of artifacts downloaded at once.
+// Others wait in the queue in the requested order. (OS software module is requested first)
+class DownloadScheduler : public IClassName,
+                          public ISingleton<DownloadScheduler> {
+friend class ISingleton<DownloadScheduler>;
+public:
+    virtual ~DownloadScheduler();
+
+    // Starts the download now if a slot is available. Otherwise it waits in the queue.
+    bool request(DownloadSchedulerListener* listener);
+    // Called when the download doesn't need the slot any more. (completed, failed, paused or canceled)
+    void release(DownloadSchedulerListener* listener);
+
+private:
+    DownloadScheduler();
+
+    void startNext();
+
+    deque<DownloadSchedulerListener*> m_waiting;
+    set<DownloadSchedulerListener*> m_running;
+    bool m_isScheduled;
+};
+
+#endif /* CORE_INSTALL_DESIGN_DOWNLOADSCHEDULER_H_ */
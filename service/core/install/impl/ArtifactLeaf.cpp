@@ -17,41 +17,55 @@
 #include "core/install/impl/ArtifactLeaf.h"
 
 #include "PolicyManager.h"
+#include "Setting.h"
 #include "updater/AbsUpdater.h"
 #include "util/JValueUtil.h"
 #include "util/Util.h"
 
 // TODO change to /media/internal/downloads and delete downloaded files.
 const string ArtifactLeaf::DIRNAME = "/home/root/";
+const string ArtifactLeaf::STREAMED_SUFFIX = ".streamed";
 
 ArtifactLeaf::ArtifactLeaf()
     : m_total(0)
     , m_curSize(0)
     , m_prevSize(0)
+    , m_installProgress(0)
+    , m_installError(0)
+    , m_writtenBlocks(0)
+    , m_skippedBlocks(0)
+    , m_isStreamed(false)
+    , m_isInstalling(false)
+    , m_isInstallCanceled(false)
+    , m_token(make_shared<int>(0))
 {
     setClassName("ArtifactLeaf");
 }
 
 ArtifactLeaf::~ArtifactLeaf()
 {
+    DownloadScheduler::getInstance().release(this);
     m_httpFile = nullptr;
+    m_stream = nullptr;
 }
 
 void ArtifactLeaf::onStartedDownload(HttpFile* call)
 {
     Logger::info(getClassName(), m_fileName, __FUNCTION__);
     m_curSize = call->getFilesize();
+    setDirty();
 }
 
 void ArtifactLeaf::onProgressDownload(HttpFile* call)
 {
     m_curSize = call->getFilesize();
+    setDirty();
 
     // To avoid many subscription issues.
     if ((m_curSize - m_prevSize) > (1024 * 512)) {
-        Logger::debug(getClassName(), m_fileName, std::string(__FUNCTION__) + " (" + to_string(m_curSize) + "/" + to_string(m_total) + ")");
+        LOG_DEBUG(getClassName(), m_fileName, std::string(__FUNCTION__) + " (" + to_string(m_curSize) + "/" + to_string(m_total) + ")");
         if (m_listener)
-            m_listener->onChangedStatus(this);
+            m_listener->onChangedProgress(this);
         m_prevSize = m_curSize;
     }
 }
@@ -59,15 +73,61 @@ void ArtifactLeaf::onProgressDownload(HttpFile* call)
 void ArtifactLeaf::onCompletedDownload(HttpFile* call)
 {
     Logger::info(getClassName(), m_fileName, __FUNCTION__);
+    DownloadScheduler::getInstance().release(this);
     m_curSize = call->getFilesize();
+    setDirty();
+
+    if (m_stream) {
+        // The image is in the partition already. It is valid only if the digest matches.
+        // Flushing the stream syncs the partition, so it is done on the worker thread.
+        shared_ptr<StreamWriter> stream = m_stream;
+        HashContext hash = call->getHash();
+        string sha1 = m_sha1;
+        string md5 = m_md5;
+        string sha256 = m_sha256;
+        shared_ptr<HttpFile> httpFile = m_httpFile;
+        shared_ptr<DeployResult> deployResult = make_shared<DeployResult>();
+        weak_ptr<int> token = m_token;
+        m_stream = nullptr;
+        bool isExecuted = InstallExecutor::getInstance().execute([=] () mutable {
+            return verify(hash, sha1, md5, sha256) && stream->finish(*deployResult);
+        }, [this, token, httpFile, deployResult] (bool result) {
+            // This artifact can be released, or the download can be canceled while finishing
+            if (token.expired() || m_httpFile != httpFile)
+                return;
+            setDeployResult(*deployResult);
+            onFinishedStream(result);
+        });
+        if (!isExecuted)
+            onFinishedStream(false);
+        return;
+    }
 
     if (m_listener)
         m_listener->onCompletedDownload(this);
 }
 
+void ArtifactLeaf::onFinishedStream(bool result)
+{
+    if (!result) {
+        Logger::error(getClassName(), m_fileName, "Failed to install streaming image");
+        if (m_listener)
+            m_listener->onFailedDownload(this);
+        return;
+    }
+    m_isStreamed = true;
+    // The image is only in the partition. The marker keeps it installed after restart.
+    if (!Util::touchFile(getDownloadName() + STREAMED_SUFFIX))
+        Logger::warning(getClassName(), m_fileName, "Failed to save streaming result");
+    if (m_listener)
+        m_listener->onCompletedDownload(this);
+}
+
 void ArtifactLeaf::onFailedDownload(HttpFile* call)
 {
     Logger::error(getClassName(), m_fileName, __FUNCTION__);
+    DownloadScheduler::getInstance().release(this);
+    m_stream = nullptr;
 
     if (m_listener)
         m_listener->onFailedDownload(this);
@@ -93,137 +153,356 @@ void ArtifactLeaf::onInstallSubscription(pbnjson::JValue subscriptionPayload)
     }
 }
 
+bool ArtifactLeaf::onStartDownload()
+{
+    LOG_DEBUG(getClassName(), m_fileName, __FUNCTION__);
+
+    return sendHttpFile();
+}
+
+void ArtifactLeaf::onFailedStartDownload()
+{
+    Logger::error(getClassName(), m_fileName, __FUNCTION__);
+    m_httpFile = nullptr;
+    m_stream = nullptr;
+
+    if (m_listener)
+        m_listener->onFailedDownload(this);
+}
+
 bool ArtifactLeaf::startDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
-    m_httpFile = make_shared<HttpFile>();
-    m_httpFile->open(MethodType_GET, m_url);
-    m_httpFile->setFilename(getDownloadName());
-    m_httpFile->setListener(this);
-    // TODO return errorCode
-    return m_httpFile->send();
+    return DownloadScheduler::getInstance().request(this);
 }
 
 bool ArtifactLeaf::pauseDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
+    DownloadScheduler::getInstance().release(this);
     m_httpFile = nullptr;
+    m_stream = nullptr;
     return true;
 }
 
 bool ArtifactLeaf::resumeDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
+    return DownloadScheduler::getInstance().request(this);
+}
+
+bool ArtifactLeaf::cancelDownload()
+{
+    LOG_DEBUG(getClassName(), __FUNCTION__);
+
+    DownloadScheduler::getInstance().release(this);
+    m_httpFile = nullptr;
+    m_stream = nullptr;
+    m_isStreamed = false;
+    Util::removeFile(getDownloadName() + STREAMED_SUFFIX);
+    if (HttpFile::remove(getDownloadName())) {
+        m_curSize = 0;
+        m_prevSize = 0;
+        setDirty();
+    }
+    return true;
+}
+
+bool ArtifactLeaf::sendHttpFile()
+{
     m_httpFile = make_shared<HttpFile>();
     m_httpFile->open(MethodType_GET, m_url);
     m_httpFile->setFilename(getDownloadName());
     m_httpFile->setListener(this);
+    m_isStreamed = false;
+    Util::removeFile(getDownloadName() + STREAMED_SUFFIX);
+    if (openStream()) {
+        m_curSize = 0;
+        m_prevSize = 0;
+        setDirty();
+        shared_ptr<StreamWriter> stream = m_stream;
+        m_httpFile->setWriter([stream] (const char* data, size_t size) {
+            if (stream->isFailed())
+                return HttpFileWriteResult_FAILED;
+            if (!stream->write(data, size))
+                return HttpFileWriteResult_BUSY;
+            return HttpFileWriteResult_DONE;
+        });
+    } else if (m_total >= SEGMENT_THRESHOLD && getFileExtension() != "ipk") {
+        // Large images are downloaded over several connections
+        m_httpFile->setSegments(SEGMENT_COUNT, m_total);
+    } else {
+        m_httpFile->setTotal(m_total);
+    }
     // TODO return errorCode
     return m_httpFile->send();
 }
 
-bool ArtifactLeaf::cancelDownload()
+bool ArtifactLeaf::openStream()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    m_stream = nullptr;
+    // opt-in with "streaming" : "true" in the software module metadata
+    if (JValueUtil::getMeta(m_metadata, "streaming") != "true")
+        return false;
+
+    PartitionLabel partitionLabel = PartitionLabel_NONE;
+    if (getFileExtension() == "img") {
+        partitionLabel = PartitionLabel_BOOT;
+    } else if (getFileExtension() == "gz") {
+        partitionLabel = PartitionLabel_SYSTEM;
+    } else if (getFileExtension() == "zst") {
+        partitionLabel = getZstdPartitionLabel();
+    } else {
+        return false;
+    }
 
-    m_httpFile = nullptr;
-    if (Util::removeFile(getDownloadName())) {
-        m_curSize = 0;
-        m_prevSize = 0;
+    shared_ptr<AbsUpdateStream> stream = AbsUpdaterFactory::getInstance().openStream(m_fileName, partitionLabel, createDeployOptions());
+    if (!stream) {
+        Logger::warning(getClassName(), m_fileName, "Streaming install is not available. Download the file first");
+        return false;
     }
+    m_stream = make_shared<StreamWriter>(stream);
+    // curl is paused while the queue is full
+    weak_ptr<int> token = m_token;
+    m_stream->setReadyCallback([this, token] {
+        Util::async([this, token] {
+            if (token.expired() || !m_httpFile)
+                return;
+            m_httpFile->resume();
+        });
+    });
+    if (!m_stream->open()) {
+        m_stream = nullptr;
+        return false;
+    }
+    Logger::info(getClassName(), m_fileName, "Streaming install");
     return true;
 }
 
+PartitionLabel ArtifactLeaf::getZstdPartitionLabel()
+{
+    // boot.img.zst goes to boot partition like boot.img
+    string name = m_fileName.substr(0, m_fileName.find_last_of("."));
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".img") == 0)
+        return PartitionLabel_BOOT;
+    return PartitionLabel_SYSTEM;
+}
+
+bool ArtifactLeaf::verify(const string& path, const string& sha1, const string& md5, const string& sha256)
+{
+    HashContext hash;
+    if (!HttpFile::loadHash(path, hash)) {
+        // The file isn't hashed while downloading. Read it again.
+        Logger::info("ArtifactLeaf", path, "Hash is not available. Calculate SHA1 from file");
+        return Util::sha1(path) == sha1;
+    }
+    return verify(hash, sha1, md5, sha256);
+}
+
+bool ArtifactLeaf::verify(HashContext& hash, const string& sha1, const string& md5, const string& sha256)
+{
+    if (hash.getSha1() != sha1) {
+        Logger::error("ArtifactLeaf", __FUNCTION__, "SHA1 mismatch");
+        return false;
+    }
+    if (!md5.empty() && hash.getMd5() != md5) {
+        Logger::error("ArtifactLeaf", __FUNCTION__, "MD5 mismatch");
+        return false;
+    }
+    if (!sha256.empty() && hash.getSha256() != sha256) {
+        Logger::error("ArtifactLeaf", __FUNCTION__, "SHA256 mismatch");
+        return false;
+    }
+    return true;
+}
+
+DeployProgressCallback ArtifactLeaf::createProgressCallback()
+{
+    // Called on the worker thread. Only changes of percentage go to the main loop.
+    weak_ptr<int> token = m_token;
+    shared_ptr<int> lastProgress = make_shared<int>(0);
+    return [this, token, lastProgress] (uint64_t current, uint64_t total) {
+        int progress = (total > 0) ? (int) (current * 100 / total) : 0;
+        if (progress == *lastProgress)
+            return;
+        *lastProgress = progress;
+        Util::async([this, token, progress] {
+            if (token.expired())
+                return;
+            m_installProgress = progress;
+            setDirty();
+            if (m_listener)
+                m_listener->onChangedProgress(this);
+        });
+    };
+}
+
+DeployOptions ArtifactLeaf::createDeployOptions()
+{
+    DeployOptions options;
+    // "writeMode" : "compare" or "overwrite" in the software module metadata. WRITE_MODE is the default.
+    string writeMode = JValueUtil::getMeta(m_metadata, "writeMode");
+    if (writeMode == "compare") {
+        options.isCompareWrite = true;
+    } else if (writeMode == "overwrite") {
+        options.isCompareWrite = false;
+    } else {
+        options.isCompareWrite = Setting::getInstance().isCompareWrite();
+    }
+    return options;
+}
+
+bool ArtifactLeaf::executeInstall(InstallExecutor::Work work, InstallExecutor::Callback callback)
+{
+    weak_ptr<int> token = m_token;
+    m_isInstalling = true;
+    m_isInstallCanceled = false;
+    m_installProgress = 0;
+    m_installError = 0;
+    m_writtenBlocks = 0;
+    m_skippedBlocks = 0;
+    setDirty();
+    return InstallExecutor::getInstance().execute(work, [this, token, callback] (bool result) {
+        // This artifact can be released while installing
+        if (token.expired())
+            return;
+        m_isInstalling = false;
+        if (m_isInstallCanceled) {
+            Logger::info(getClassName(), m_fileName, "Install is canceled");
+            AbsUpdaterFactory::getInstance().undeploy();
+            return;
+        }
+        callback(result);
+    });
+}
+
+void ArtifactLeaf::setDeployResult(const DeployResult& result)
+{
+    m_installError = result.error;
+    m_writtenBlocks = result.writtenBlocks;
+    m_skippedBlocks = result.skippedBlocks;
+    if (m_installError != 0)
+        Logger::error(getClassName(), m_fileName, "Failed to write partition : " + string(strerror(m_installError)));
+    setDirty();
+}
+
+void ArtifactLeaf::onFinishedInstall(bool result)
+{
+    if (result) {
+        m_installProgress = 100;
+        setDirty();
+        if (m_listener)
+            m_listener->onCompletedInstall(this);
+    } else {
+        if (m_listener)
+            m_listener->onFailedInstall(this);
+    }
+}
+
 bool ArtifactLeaf::startInstall()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     // Wait for this deployment action's status to be "installStarted" and posting "getStatus".
     // Otherwise, "installStarted" status can come after "installCompleted" or "failed".
     return Util::async([=] {
-        if (Util::sha1(getDownloadName()) != m_sha1) {
-            Logger::error(getClassName(), m_fileName, "SHA1 verification failed");
-            if (m_listener)
-                m_listener->onFailedInstall(this);
+        if (m_isStreamed) {
+            // written and verified while downloading
+            Logger::info(getClassName(), m_fileName, "Already installed by streaming");
+            AbsUpdaterFactory::getInstance().printDebug();
+            onFinishedInstall(true);
             return true;
         }
 
-        if (getFileExtension() == "ipk") {
-            string installer = JValueUtil::getMeta(m_metadata, "installer");
-            if (installer.empty() || installer == "appInstallService") {
+        // Works on the worker thread use only these copies
+        string path = getDownloadName();
+        string sha1 = m_sha1;
+        string md5 = m_md5;
+        string sha256 = m_sha256;
+        string extension = getFileExtension();
+        string installer = JValueUtil::getMeta(m_metadata, "installer");
+
+        if (extension == "ipk" && (installer.empty() || installer == "appInstallService")) {
+            string ipkName = getIpkName();
+            bool isExecuted = executeInstall([=] {
+                if (!verify(path, sha1, md5, sha256))
+                    return false;
                 // TODO: Following is temp code for demo. we need to find better way
-                string command = "opkg remove " + getIpkName();
+                string command = "opkg remove " + ipkName;
                 system(command.c_str());
-                AppInstaller::getInstance().install(getIpkName(), getDownloadName(), this);
                 return true;
-            } else if (installer == "opkg") {
-                AbsUpdaterFactory::getInstance().setReadWriteMode();
-                string command = "opkg install --force-reinstall --force-downgrade " + getDownloadName();
-                if (system(command.c_str()) == 0) {
-                    if (m_listener)
-                        m_listener->onCompletedInstall(this);
-                } else {
-                    if (m_listener)
-                        m_listener->onFailedInstall(this);
+            }, [this, ipkName, path] (bool result) {
+                if (!result) {
+                    Logger::error(getClassName(), m_fileName, "Hash verification failed");
+                    onFinishedInstall(false);
+                    return;
                 }
-                return true;
-            }
-        } else if (getFileExtension() == "delta") { // ostree-hash1-hash2.delta
-            if (AbsUpdaterFactory::getInstance().deploy(getDownloadName())) {
-                AbsUpdaterFactory::getInstance().printDebug();
-                if (m_listener)
-                    m_listener->onCompletedInstall(this);
-            } else {
-                if (m_listener)
-                    m_listener->onFailedInstall(this);
-            }
+                AppInstaller::getInstance().install(ipkName, path, this);
+            });
+            if (!isExecuted)
+                onFinishedInstall(false);
             return true;
-        } else if (getFileExtension() == "img") { // boot.img
-            if (AbsUpdaterFactory::getInstance().deploy(getDownloadName(), PartitionLabel_BOOT)) {
-                AbsUpdaterFactory::getInstance().printDebug();
-                if (m_listener)
-                    m_listener->onCompletedInstall(this);
-            } else {
-                if (m_listener)
-                    m_listener->onFailedInstall(this);
-            }
+        }
+
+        bool isPackage = false;
+        PartitionLabel partitionLabel = PartitionLabel_NONE;
+        if (extension == "ipk" && installer == "opkg") {
+            isPackage = true;
+        } else if (extension == "delta") { // ostree-hash1-hash2.delta
+            partitionLabel = PartitionLabel_NONE;
+        } else if (extension == "img") { // boot.img
+            partitionLabel = PartitionLabel_BOOT;
+        } else if (extension == "gz") { // webos-image.ext4.gz
+            partitionLabel = PartitionLabel_SYSTEM;
+        } else if (extension == "zst") { // boot.img.zst or webos-image.ext4.zst
+            partitionLabel = getZstdPartitionLabel();
+        } else if (extension == "xd3") { // xdelta3
+            partitionLabel = PartitionLabel_SYSTEM;
+        } else {
+            Logger::warning(getClassName(), m_fileName, "Not supported file extension");
+            onFinishedInstall(false);
             return true;
-        } else if (getFileExtension() == "gz") { // webos-image.ext4.gz
-            if (AbsUpdaterFactory::getInstance().deploy(getDownloadName(), PartitionLabel_SYSTEM)) {
-                AbsUpdaterFactory::getInstance().printDebug();
-                if (m_listener)
-                    m_listener->onCompletedInstall(this);
-            } else {
-                if (m_listener)
-                    m_listener->onFailedInstall(this);
+        }
+
+        DeployOptions options = createDeployOptions();
+        options.progressCallback = createProgressCallback();
+        shared_ptr<DeployResult> deployResult = make_shared<DeployResult>();
+        bool isExecuted = executeInstall([=] {
+            if (!verify(path, sha1, md5, sha256)) {
+                Logger::error("ArtifactLeaf", path, "Hash verification failed");
+                return false;
             }
-            return true;
-        } else if (getFileExtension() == "xd3") { // xdelta3
-            if (AbsUpdaterFactory::getInstance().deploy(getDownloadName(), PartitionLabel_SYSTEM)) {
-                AbsUpdaterFactory::getInstance().printDebug();
-                if (m_listener)
-                    m_listener->onCompletedInstall(this);
-            } else {
-                if (m_listener)
-                    m_listener->onFailedInstall(this);
+            if (isPackage) {
+                AbsUpdaterFactory::getInstance().setReadWriteMode();
+                string command = "opkg install --force-reinstall --force-downgrade " + path;
+                return system(command.c_str()) == 0;
             }
-            return true;
-        }
 
-        Logger::warning(getClassName(), m_fileName, "Not supported file extension");
-        if (m_listener)
-            m_listener->onFailedInstall(this);
+            return AbsUpdaterFactory::getInstance().deploy(path, partitionLabel, options, *deployResult);
+        }, [this, isPackage, deployResult] (bool result) {
+            setDeployResult(*deployResult);
+            if (result && !isPackage)
+                AbsUpdaterFactory::getInstance().printDebug();
+            onFinishedInstall(result);
+        });
+        if (!isExecuted)
+            onFinishedInstall(false);
         return true;
     }, 50);
 }
 
 bool ArtifactLeaf::cancelInstall()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
+    if (m_isInstalling) {
+        // Partition can't be restored while it is written. Undeploy after the work is done.
+        m_isInstallCanceled = true;
+        return true;
+    }
     return AbsUpdaterFactory::getInstance().undeploy();
 }
 
@@ -235,6 +514,7 @@ bool ArtifactLeaf::fromJson(const JValue& json)
     JValueUtil::getValue(json, "filename", m_fileName);
     JValueUtil::getValue(json, "hashes", "sha1", m_sha1);
     JValueUtil::getValue(json, "hashes", "md5", m_md5);
+    JValueUtil::getValue(json, "hashes", "sha256", m_sha256);
 
     JValueUtil::getValue(json, "_links", "md5sum", "href", m_md5sum);
     JValueUtil::getValue(json, "_links", "download", "href", m_url);
@@ -243,6 +523,8 @@ bool ArtifactLeaf::fromJson(const JValue& json)
         JValueUtil::getValue(json, "_links", "md5sum-http", "href", m_md5sum);
         JValueUtil::getValue(json, "_links", "download-http", "href", m_url);
     }
+    // written to the partition by streaming before restart
+    m_isStreamed = Util::isFileExist(getDownloadName() + STREAMED_SUFFIX);
     return true;
 }
 
@@ -253,5 +535,12 @@ bool ArtifactLeaf::toJson(JValue& json)
     json.put("filename", m_fileName);
     json.put("total", m_total);
     json.put("size", m_curSize);
+    json.put("installProgress", m_installProgress);
+    if (m_installError != 0)
+        json.put("installError", strerror(m_installError));
+    if (m_writtenBlocks + m_skippedBlocks > 0) {
+        json.put("writtenBlocks", (int64_t) m_writtenBlocks);
+        json.put("skippedBlocks", (int64_t) m_skippedBlocks);
+    }
     return true;
 }
@@ -22,8 +22,12 @@
 
 #include "core/Status.h"
 #include "core/HttpFile.h"
+#include "core/InstallExecutor.h"
+#include "core/StreamWriter.h"
 #include "core/install/design/Composite.h"
+#include "core/install/design/DownloadScheduler.h"
 #include "ls2/AppInstaller.h"
+#include "updater/AbsUpdater.h"
 #include "interface/IClassName.h"
 #include "interface/IListener.h"
 #include "interface/ISerializable.h"
@@ -34,6 +38,7 @@ using namespace pbnjson;
 class ArtifactLeaf : public IClassName,
                      public HttpFileListener,
                      public AppInstallerListener,
+                     public DownloadSchedulerListener,
                      public Composite,
                      public IListener<CompositeListener> {
 public:
@@ -49,6 +54,10 @@ public:
     // AppInstallerListener
     virtual void onInstallSubscription(pbnjson::JValue subscriptionPayload) override;
 
+    // DownloadSchedulerListener
+    virtual bool onStartDownload() override;
+    virtual void onFailedStartDownload() override;
+
     // Composite
     virtual bool startDownload() override;
     virtual bool pauseDownload() override;
@@ -90,24 +99,61 @@ public:
 
 private:
     const static string DIRNAME;
+    // marker next to the download name. The image is in the partition already.
+    const static string STREAMED_SUFFIX;
+    const static int64_t SEGMENT_THRESHOLD = 64 * 1024 * 1024;
+    const static unsigned int SEGMENT_COUNT = 4;
+
+    bool sendHttpFile();
+    bool openStream();
+    void onFinishedStream(bool result);
+    PartitionLabel getZstdPartitionLabel();
+    // They can be called on worker threads
+    static bool verify(const string& path, const string& sha1, const string& md5, const string& sha256);
+    static bool verify(HashContext& hash, const string& sha1, const string& md5, const string& sha256);
+
+    DeployProgressCallback createProgressCallback();
+    DeployOptions createDeployOptions();
+    bool executeInstall(InstallExecutor::Work work, InstallExecutor::Callback callback);
+    // called on the main loop with the result from the worker thread
+    void setDeployResult(const DeployResult& result);
+    void onFinishedInstall(bool result);
 
     // file info
     string m_fileName;
 
     // file size
-    int m_total;
-    int m_curSize;
-    int m_prevSize;
+    // Images can be larger than 2GB
+    int64_t m_total;
+    int64_t m_curSize;
+    int64_t m_prevSize;
+    int m_installProgress;
+    // errno of the partition write. (0 if no error)
+    int m_installError;
+    // blocks of the partition which are written / skipped (compare write mode)
+    uint64_t m_writtenBlocks;
+    uint64_t m_skippedBlocks;
 
     // hash value
     string m_sha1;
     string m_md5;
+    string m_sha256;
 
     // download link
     string m_md5sum;
     string m_url;
 
     shared_ptr<HttpFile> m_httpFile;
+    // streaming install. The stream is written on its own thread.
+    shared_ptr<StreamWriter> m_stream;
+    bool m_isStreamed;
+
+    // install on the worker thread
+    bool m_isInstalling;
+    bool m_isInstallCanceled;
+    // expired when this artifact is released. Results from worker threads are dropped.
+    shared_ptr<int> m_token;
+
     JValue m_metadata;
 };
 
@@ -34,6 +34,7 @@ DeploymentActionComposite::DeploymentActionComposite()
     : AbsAction()
     , m_isForceDownload(false)
     , m_isForceUpdate(false)
+    , m_isPipelined(Setting::getInstance().isPipelinedInstall())
     , m_status()
 {
     setClassName("DeploymentActionComposite");
@@ -63,7 +64,16 @@ bool DeploymentActionComposite::fromJson(const JValue& json)
         shared_ptr<SoftwareModuleComposite> module = make_shared<SoftwareModuleComposite>();
         module->setListener(this);
         module->fromJson(chunk);
-        if (module->getType() == SoftwareModuleType_OS) // process OS type first
+        if (m_isPipelined) {
+            // OS type is installed last, because reboot is required after that.
+            auto it = m_children.end();
+            if (module->getType() != SoftwareModuleType_OS) {
+                it = m_children.begin();
+                while (it != m_children.end() && std::dynamic_pointer_cast<SoftwareModuleComposite>(*it)->getType() != SoftwareModuleType_OS)
+                    ++it;
+            }
+            m_children.insert(it, module);
+        } else if (module->getType() == SoftwareModuleType_OS) // process OS type first
             m_children.push_front(module);
         else
             m_children.push_back(module);
@@ -80,11 +90,10 @@ bool DeploymentActionComposite::toJson(JValue& json)
     json.put("status", m_status.getStatusStr());
     json.put("id", m_id);
 
+    // Software modules which are not changed are not serialized again
     JValue softwareModules = pbnjson::Array();
     for (auto it = m_children.begin(); it != m_children.end(); ++it) {
-        JValue softwareModule = pbnjson::Object();
-        (*it)->toJson(softwareModule);
-        softwareModules.append(softwareModule);
+        softwareModules.append((*it)->toCachedJson());
     }
     json.put("softwareModules", softwareModules);
     return true;
@@ -92,24 +101,43 @@ bool DeploymentActionComposite::toJson(JValue& json)
 
 void DeploymentActionComposite::onChangedStatus(Composite* softwareModule)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_listener)
         m_listener->onChangedStatus(this);
 }
 
+void DeploymentActionComposite::onChangedProgress(Composite* softwareModule)
+{
+    if (m_listener)
+        m_listener->onChangedProgress(this);
+}
+
 void DeploymentActionComposite::onCompletedDownload(Composite* softwareModule)
 {
-    Logger::debug(getClassName(), __FUNCTION__, to_string(m_current));
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(m_downloaded.size() + 1) + "/" + to_string(m_children.size()));
 
-    m_current++;
-    if (m_current < m_children.size()) {
-        if (!m_children[m_current]->startDownload()) {
-            onFailedDownload((SoftwareModuleComposite*)m_children[m_current].get());
+    if (m_status.getStatus() != StatusType_DOWNLOAD_STARTED)
+        return;
+    bool isCompleted = completeChildDownload(softwareModule);
+
+    if (m_isPipelined) {
+        if (!installDownloadedModule()) {
+            onFailedInstall((SoftwareModuleComposite*)m_children[m_current].get());
+            return;
         }
+        if (!isCompleted)
+            return;
+        // Remaining software modules are installed without 'startInstall'
+        setStatus(StatusType_INSTALL_STARTED);
+        if (m_listener)
+            m_listener->onCompletedDownload(this);
         return;
     }
 
+    if (!isCompleted)
+        return;
+
     setStatus(StatusType_INSTALL_READY);
 
     if (m_listener)
@@ -118,7 +146,11 @@ void DeploymentActionComposite::onCompletedDownload(Composite* softwareModule)
 
 void DeploymentActionComposite::onCompletedInstall(Composite* softwareModule)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
+
+    // With pipelined install, failed download doesn't stop the running install.
+    if (m_status.getStatus() == StatusType_FAILED)
+        return;
 
     JValue actionHistoryJson = pbnjson::Object();
     toActionHistory(actionHistoryJson);
@@ -141,6 +173,13 @@ void DeploymentActionComposite::onCompletedInstall(Composite* softwareModule)
     HawkBitClient::getInstance().proceeding(m_id, actionHistoryJson.stringify());
 
     m_current++;
+    if (m_isPipelined && m_current < m_children.size()) {
+        // Next one is installed when its download is completed
+        if (!installDownloadedModule()) {
+            onFailedInstall((SoftwareModuleComposite*)m_children[m_current].get());
+        }
+        return;
+    }
     if (m_current < m_children.size()) {
         if (!m_children[m_current]->startInstall()) {
             onFailedInstall((SoftwareModuleComposite*)m_children[m_current].get());
@@ -166,7 +205,10 @@ void DeploymentActionComposite::onCompletedInstall(Composite* softwareModule)
 
 void DeploymentActionComposite::onFailedDownload(Composite* softwareModule)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
+
+    // stop other software modules. Their files are kept to resume later.
+    pauseChildrenDownload(softwareModule);
 
     setStatus(StatusType_FAILED);
 
@@ -176,7 +218,11 @@ void DeploymentActionComposite::onFailedDownload(Composite* softwareModule)
 
 void DeploymentActionComposite::onFailedInstall(Composite* softwareModule)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
+
+    // With pipelined install, others can be downloading
+    if (m_isPipelined)
+        pauseChildrenDownload();
 
     setStatus(StatusType_FAILED);
 
@@ -186,15 +232,16 @@ void DeploymentActionComposite::onFailedInstall(Composite* softwareModule)
 
 bool DeploymentActionComposite::startDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_status.getStatus() == StatusType_DOWNLOAD_STARTED)
         return true;
     if (m_status.getStatus() != StatusType_DOWNLOAD_READY)
         return false;
 
-    m_current = 0;
-    if (!m_children[m_current]->startDownload())
+    if (m_isPipelined)
+        m_current = 0;
+    if (!startChildrenDownload())
         return false;
     setStatus(StatusType_DOWNLOAD_STARTED);
     return true;
@@ -202,14 +249,14 @@ bool DeploymentActionComposite::startDownload()
 
 bool DeploymentActionComposite::pauseDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_status.getStatus() == StatusType_DOWNLOAD_PAUSED)
         return true;
     if (m_status.getStatus() != StatusType_DOWNLOAD_STARTED)
         return false;
 
-    if (!m_children[m_current]->pauseDownload())
+    if (!pauseChildrenDownload())
         return false;
 
     setStatus(StatusType_DOWNLOAD_PAUSED);
@@ -218,14 +265,14 @@ bool DeploymentActionComposite::pauseDownload()
 
 bool DeploymentActionComposite::resumeDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_status.getStatus() == StatusType_DOWNLOAD_STARTED)
         return true;
     if (m_status.getStatus() != StatusType_DOWNLOAD_PAUSED)
         return false;
 
-    if (!m_children[m_current]->resumeDownload())
+    if (!resumeChildrenDownload())
         return false;
 
     setStatus(StatusType_DOWNLOAD_STARTED);
@@ -234,7 +281,7 @@ bool DeploymentActionComposite::resumeDownload()
 
 bool DeploymentActionComposite::cancelDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_status.getStatus() == StatusType_DOWNLOAD_READY)
         return true;
@@ -243,18 +290,27 @@ bool DeploymentActionComposite::cancelDownload()
         m_status.getStatus() != StatusType_INSTALL_READY)
         return false;
 
-    m_current = -1;
-    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
-        (void) (*it)->cancelDownload();
+    if (m_isPipelined) {
+        // Installed software modules cannot be restored.
+        for (auto it = m_children.begin(); it != m_children.end(); ++it) {
+            enum StatusType status = std::dynamic_pointer_cast<SoftwareModuleComposite>(*it)->getStatus().getStatus();
+            if (status == StatusType_INSTALL_STARTED || status == StatusType_INSTALL_COMPLETED)
+                return false;
+        }
+        if (m_current != (unsigned int) -1 && m_current > 0)
+            return false;
     }
 
+    m_current = -1;
+    cancelChildrenDownload();
+
     setStatus(StatusType_DOWNLOAD_READY);
     return true;
 }
 
 bool DeploymentActionComposite::startInstall()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_status.getStatus() == StatusType_INSTALL_STARTED)
         return true;
@@ -271,7 +327,7 @@ bool DeploymentActionComposite::startInstall()
 
 bool DeploymentActionComposite::cancelInstall()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_status.getStatus() == StatusType_INSTALL_READY)
         return true;
@@ -300,6 +356,9 @@ bool DeploymentActionComposite::fromActionHistory(const JValue& json) {
     bool isRebootRequired = json["isRebootRequired"].asBool();
     string status = json["status"].asString();
     m_current = json["currentSoftwareModule"].asNumber<int>();
+    // With pipelined install, it is the next software module to be installed while downloading
+    if (m_isPipelined && m_current == (unsigned int) -1)
+        m_current = 0;
 
     if (isRebootRequired) {
         if (!isRebootDetected) {
@@ -322,7 +381,14 @@ bool DeploymentActionComposite::fromActionHistory(const JValue& json) {
         setStatus(StatusType_DOWNLOAD_READY, false);
         return true;
     } else if (statusType == StatusType_DOWNLOAD_STARTED) {
-        if (!m_children[m_current]->startDownload())
+        unsigned int first = 0;
+        if (m_isPipelined) {
+            // Software modules before m_current are installed already. Don't download and install them again.
+            if (isRebootRequired)
+                m_current++;
+            first = min(m_current, (unsigned int) m_children.size());
+        }
+        if (!startChildrenDownload(first))
             return false;
         setStatus(StatusType_DOWNLOAD_STARTED, false);
         return true;
@@ -386,16 +452,31 @@ bool DeploymentActionComposite::createRebootAlert(SoftwareModuleType type)
 
 void DeploymentActionComposite::removeDownloadedFiles()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     for (auto it = m_children.begin(); it != m_children.end(); ++it) {
         (*it)->cancelDownload();
     }
 }
 
+bool DeploymentActionComposite::installDownloadedModule()
+{
+    if (m_current >= m_children.size())
+        return true;
+
+    shared_ptr<SoftwareModuleComposite> module = std::dynamic_pointer_cast<SoftwareModuleComposite>(m_children[m_current]);
+    // Not downloaded yet, or being installed already
+    if (module->getStatus().getStatus() != StatusType_INSTALL_READY)
+        return true;
+
+    Logger::info(getClassName(), "Pipelined install: " + module->getName());
+    return module->startInstall();
+}
+
 bool DeploymentActionComposite::setStatus(enum StatusType status, bool doFeedback)
 {
     m_status.setStatus(status);
+    setDirty();
 
     if (doFeedback) {
         JValue actionHistoryJson = pbnjson::Object();
@@ -44,6 +44,7 @@ public:
 
     // CompositeListener
     virtual void onChangedStatus(Composite* softwareModule) override;
+    virtual void onChangedProgress(Composite* softwareModule) override;
     virtual void onCompletedDownload(Composite* softwareModule) override;
     virtual void onCompletedInstall(Composite* softwareModule) override;
     virtual void onFailedDownload(Composite* softwareModule) override;
@@ -80,11 +81,21 @@ public:
     static const string FILE_NON_VOLITILE_REBOOTCHECK;
     static const string FILE_VOLITILE_REBOOTCHECK;
 
+protected:
+    // Composite
+    virtual string getChildrenKey() override
+    {
+        return "softwareModules";
+    }
+
 private:
     bool setStatus(enum StatusType status, bool doFeedback = true);
+    // pipelined install: install m_current if it is downloaded
+    bool installDownloadedModule();
 
     bool m_isForceDownload;
     bool m_isForceUpdate;
+    bool m_isPipelined;
 
     Status m_status;
 
@@ -56,8 +56,10 @@ SoftwareModuleComposite::SoftwareModuleComposite()
     : m_type(SoftwareModuleType_Unknown)
     , m_name("")
     , m_version("")
+    , m_status()
 {
     setClassName("SoftwareModuleComposite");
+    setStatus(StatusType_DOWNLOAD_READY);
 }
 
 SoftwareModuleComposite::~SoftwareModuleComposite()
@@ -95,6 +97,7 @@ bool SoftwareModuleComposite::toJson(JValue& json)
 {
     Composite::toJson(json);
 
+    json.put("status", m_status.getStatusStr());
     json.put("type", toString(m_type));
     json.put("name", m_name);
     json.put("version", m_version);
@@ -102,11 +105,10 @@ bool SoftwareModuleComposite::toJson(JValue& json)
     if (m_metadata.isValid() && !m_metadata.isNull())
         json.put("metadata", m_metadata.duplicate());
 
+    // Artifacts which are not changed are not serialized again
     JValue artifacts = pbnjson::Array();
     for (auto it = m_children.begin(); it != m_children.end(); ++it) {
-        JValue artifact = pbnjson::Object();
-        (*it)->toJson(artifact);
-        artifacts.append(artifact);
+        artifacts.append((*it)->toCachedJson());
     }
     json.put("artifacts", artifacts);
     return true;
@@ -114,31 +116,33 @@ bool SoftwareModuleComposite::toJson(JValue& json)
 
 void SoftwareModuleComposite::onChangedStatus(Composite* artifact)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     if (m_listener)
         m_listener->onChangedStatus(this);
 }
 
+void SoftwareModuleComposite::onChangedProgress(Composite* artifact)
+{
+    if (m_listener)
+        m_listener->onChangedProgress(this);
+}
+
 void SoftwareModuleComposite::onCompletedDownload(Composite* artifact)
 {
-    Logger::debug(getClassName(), __FUNCTION__, to_string(m_current));
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(m_downloaded.size() + 1) + "/" + to_string(m_children.size()));
 
-    m_current++;
-    if (m_current < m_children.size()) {
-        if (!m_children[m_current]->startDownload()) {
-            onFailedDownload((ArtifactLeaf*)m_children[m_current].get());
-        }
+    if (!completeChildDownload(artifact))
         return;
-    }
 
+    setStatus(StatusType_INSTALL_READY);
     if (m_listener)
         m_listener->onCompletedDownload(this);
 }
 
 void SoftwareModuleComposite::onCompletedInstall(Composite* artifact)
 {
-    Logger::debug(getClassName(), __FUNCTION__, to_string(m_current));
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(m_current));
     // m_current is -1, if 'cancelInstall' is invoked.
     if (m_current == -1)
         return;
@@ -151,79 +155,93 @@ void SoftwareModuleComposite::onCompletedInstall(Composite* artifact)
         return;
     }
 
+    setStatus(StatusType_INSTALL_COMPLETED);
     if (m_listener)
         m_listener->onCompletedInstall(this);
 }
 
 void SoftwareModuleComposite::onFailedDownload(Composite* artifact)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
+    // stop other artifacts. Their files are kept to resume later.
+    pauseChildrenDownload(artifact);
+
+    setStatus(StatusType_FAILED);
     if (m_listener)
         m_listener->onFailedDownload(this);
 }
 
 void SoftwareModuleComposite::onFailedInstall(Composite* artifact)
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
+    setStatus(StatusType_FAILED);
     if (m_listener)
         m_listener->onFailedInstall(this);
 }
 
 bool SoftwareModuleComposite::startDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
-    m_current = 0;
-    return m_children[m_current]->startDownload();
+    if (!startChildrenDownload())
+        return false;
+    setStatus(StatusType_DOWNLOAD_STARTED);
+    return true;
 }
 
 bool SoftwareModuleComposite::pauseDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
-    return m_children[m_current]->pauseDownload();
+    if (!pauseChildrenDownload())
+        return false;
+    if (m_status.getStatus() == StatusType_DOWNLOAD_STARTED)
+        setStatus(StatusType_DOWNLOAD_PAUSED);
+    return true;
 }
 
 bool SoftwareModuleComposite::resumeDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
-    // m_current is -1, if swupdater is respawned (or rebooted) while downloadPaused
-    if (m_current == -1)
-        m_current = 0;
-    return m_children[m_current]->resumeDownload();
+    if (!resumeChildrenDownload())
+        return false;
+    if (m_status.getStatus() != StatusType_INSTALL_READY)
+        setStatus(StatusType_DOWNLOAD_STARTED);
+    return true;
 }
 
 bool SoftwareModuleComposite::cancelDownload()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
-
-    m_current = -1;
-    for (auto it = m_children.begin(); it != m_children.end(); ++it) {
-        (void) (*it)->cancelDownload();
-    }
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
+    cancelChildrenDownload();
+    setStatus(StatusType_DOWNLOAD_READY);
     return true;
 }
 
 bool SoftwareModuleComposite::startInstall()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     m_current = 0;
-    return m_children[m_current]->startInstall();
+    if (!m_children[m_current]->startInstall())
+        return false;
+    setStatus(StatusType_INSTALL_STARTED);
+    return true;
 }
 
 bool SoftwareModuleComposite::cancelInstall()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     m_current = -1;
     for (auto it = m_children.begin(); it != m_children.end(); ++it) {
         (void) (*it)->cancelInstall();
     }
 
+    setStatus(StatusType_INSTALL_READY);
     return true;
 }
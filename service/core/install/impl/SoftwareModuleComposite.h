@@ -21,6 +21,7 @@
 #include <deque>
 #include <pbnjson.hpp>
 
+#include "core/Status.h"
 #include "core/install/design/Composite.h"
 #include "core/install/impl/ArtifactLeaf.h"
 #include "interface/IClassName.h"
@@ -54,6 +55,7 @@ public:
 
     // CompositeListener
     virtual void onChangedStatus(Composite* artifact) override;
+    virtual void onChangedProgress(Composite* artifact) override;
     virtual void onCompletedDownload(Composite* artifact) override;
     virtual void onCompletedInstall(Composite* artifact) override;
     virtual void onFailedDownload(Composite* artifact) override;
@@ -87,13 +89,33 @@ public:
         return m_metadata;
     }
 
+    // phase of this software module. Modules can be in different phases with pipelined install.
+    Status& getStatus()
+    {
+        return m_status;
+    }
+
 protected:
+    // Composite
+    virtual string getChildrenKey() override
+    {
+        return "artifacts";
+    }
+
+    void setStatus(enum StatusType status)
+    {
+        m_status.setStatus(status);
+        setDirty();
+    }
+
     enum SoftwareModuleType m_type;
     string m_name;
     string m_version;
 
     JValue m_metadata;
 
+    Status m_status;
+
 };
 
 
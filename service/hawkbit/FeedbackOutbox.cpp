@@ -0,0 +1,253 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "hawkbit/FeedbackOutbox.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/Logger.h"
+
+string FeedbackOutbox::toString(MethodType method)
+{
+    switch (method) {
+    case MethodType_GET:    return "GET";
+    case MethodType_POST:   return "POST";
+    case MethodType_PUT:    return "PUT";
+    case MethodType_DELETE: return "DELETE";
+    default:
+        break;
+    }
+    return "NONE";
+}
+
+MethodType FeedbackOutbox::toMethodType(const string& method)
+{
+    if (method == "GET")
+        return MethodType_GET;
+    if (method == "POST")
+        return MethodType_POST;
+    if (method == "PUT")
+        return MethodType_PUT;
+    if (method == "DELETE")
+        return MethodType_DELETE;
+    return MethodType_NONE;
+}
+
+FeedbackOutbox::FeedbackOutbox()
+    : m_path("")
+    , m_fd(-1)
+    , m_lines(0)
+    , m_seq(0)
+{
+    setClassName("FeedbackOutbox");
+}
+
+FeedbackOutbox::~FeedbackOutbox()
+{
+    close();
+}
+
+bool FeedbackOutbox::open(const string& path)
+{
+    m_path = path;
+    m_feedbacks.clear();
+    m_lines = 0;
+
+    // Feedbacks which are not acked yet, in the order of 'seq'
+    map<uint64_t, Feedback> feedbacks;
+    ifstream file(path);
+    string text;
+    // Damaged lines are rewritten. Otherwise, the next line is appended to the torn one and it is lost.
+    bool isDamaged = false;
+    // size of the lines which end with '\n'
+    off_t completeSize = 0;
+    while (getline(file, text)) {
+        // The last line can be torn by power loss
+        if (file.eof()) {
+            isDamaged = true;
+        } else {
+            completeSize = file.tellg();
+        }
+        JValue line = JDomParser::fromString(text);
+        if (!line.isObject()) {
+            isDamaged = true;
+            continue;
+        }
+        m_lines++;
+        uint64_t seq = 0;
+        if (line.hasKey("ack")) {
+            seq = line["ack"].asNumber<int64_t>();
+            feedbacks.erase(seq);
+        } else if (line.hasKey("seq")) {
+            seq = line["seq"].asNumber<int64_t>();
+            Feedback& feedback = feedbacks[seq];
+            feedback.seq = seq;
+            feedback.method = toMethodType(line["method"].asString());
+            feedback.url = line["url"].asString();
+            feedback.payload = line["payload"];
+            feedback.actionId = line["actionId"].asString();
+            feedback.isProceeding = line["isProceeding"].asBool();
+        }
+        m_seq = max(m_seq, seq);
+    }
+    for (auto& it : feedbacks) {
+        m_feedbacks.push_back(it.second);
+    }
+    if (!m_feedbacks.empty()) {
+        Logger::info(getClassName(), to_string(m_feedbacks.size()) + " feedbacks are not sent yet");
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        Logger::error(getClassName(), "Failed to open " + path + " : " + strerror(errno));
+        return false;
+    }
+    if (!isDamaged)
+        return compact();
+
+    Logger::warning(getClassName(), "Journal is damaged. Rewrite it");
+    if (compact(true))
+        return true;
+    // At least, new lines shouldn't be appended to the torn one
+    return ftruncate(m_fd, completeSize) == 0;
+}
+
+void FeedbackOutbox::close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool FeedbackOutbox::push(Feedback& feedback, bool isFrontSending)
+{
+    feedback.seq = ++m_seq;
+
+    if (feedback.isProceeding && !feedback.actionId.empty()) {
+        auto it = m_feedbacks.begin();
+        if (isFrontSending && it != m_feedbacks.end())
+            ++it;
+        while (it != m_feedbacks.end()) {
+            if (!it->isProceeding || it->actionId != feedback.actionId) {
+                ++it;
+                continue;
+            }
+            LOG_DEBUG(getClassName(), "Superseded 'proceeding' of " + it->actionId);
+            JValue line = pbnjson::Object();
+            line.put("ack", (int64_t) it->seq);
+            append(line);
+            it = m_feedbacks.erase(it);
+        }
+    }
+
+    m_feedbacks.push_back(feedback);
+    // It is kept in memory even if it isn't saved, so it is still sent while the service is running
+    return append(toJson(feedback));
+}
+
+void FeedbackOutbox::pop()
+{
+    if (m_feedbacks.empty())
+        return;
+
+    JValue line = pbnjson::Object();
+    line.put("ack", (int64_t) m_feedbacks.front().seq);
+    m_feedbacks.pop_front();
+
+    if ((m_feedbacks.empty() || m_lines >= COMPACT_LINES) && compact())
+        return;
+    append(line);
+}
+
+bool FeedbackOutbox::append(const JValue& line)
+{
+    if (m_fd < 0)
+        return false;
+
+    string text = line.stringify() + "\n";
+    if (write(m_fd, text.c_str(), text.length()) != (ssize_t) text.length()) {
+        Logger::error(getClassName(), "Failed to write journal : " + string(strerror(errno)));
+        return false;
+    }
+    // The feedback should survive sudden power off
+    fdatasync(m_fd);
+    m_lines++;
+    return true;
+}
+
+bool FeedbackOutbox::compact(bool isForced)
+{
+    if (m_fd < 0)
+        return false;
+    if (m_feedbacks.empty()) {
+        m_lines = 0;
+        return ftruncate(m_fd, 0) == 0 && fdatasync(m_fd) == 0;
+    }
+    if (m_lines == m_feedbacks.size() && !isForced)
+        return true;
+
+    // Pending feedbacks only. The new journal replaces the old one atomically.
+    string tmpPath = m_path + ".tmp";
+    string text;
+    for (Feedback& feedback : m_feedbacks) {
+        text += toJson(feedback).stringify() + "\n";
+    }
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Logger::error(getClassName(), "Failed to open " + tmpPath + " : " + strerror(errno));
+        return false;
+    }
+    bool isWritten = write(fd, text.c_str(), text.length()) == (ssize_t) text.length() && fdatasync(fd) == 0;
+    ::close(fd);
+    if (!isWritten || rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+        Logger::error(getClassName(), "Failed to compact journal : " + string(strerror(errno)));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    // The rename itself is durable only after the directory is synced
+    size_t slash = m_path.find_last_of('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : m_path.substr(0, slash));
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0 || fsync(dirFd) != 0) {
+        Logger::warning(getClassName(), "Failed to sync " + dir + " : " + strerror(errno));
+    }
+    if (dirFd >= 0)
+        ::close(dirFd);
+
+    close();
+    m_fd = ::open(m_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    m_lines = m_feedbacks.size();
+    return m_fd >= 0;
+}
+
+JValue FeedbackOutbox::toJson(Feedback& feedback)
+{
+    JValue json = pbnjson::Object();
+    json.put("seq", (int64_t) feedback.seq);
+    json.put("method", toString(feedback.method));
+    json.put("url", feedback.url);
+    json.put("payload", feedback.payload);
+    json.put("actionId", feedback.actionId);
+    json.put("isProceeding", feedback.isProceeding);
+    return json;
+}
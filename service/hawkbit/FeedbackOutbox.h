@@ -0,0 +1,93 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef HAWKBIT_FEEDBACKOUTBOX_H_
+#define HAWKBIT_FEEDBACKOUTBOX_H_
+
+#include <deque>
+#include <iostream>
+#include <pbnjson.hpp>
+#include <stdint.h>
+
+#include "core/HttpRequest.h"
+#include "interface/IClassName.h"
+
+using namespace std;
+using namespace pbnjson;
+
+// Feedbacks to hawkBit which are not delivered yet. They survive reboots.
+// The journal is append-only: a line for each feedback and a line for each one which is done ('ack').
+// It is compacted when it is drained or it has too many lines.
+class FeedbackOutbox : public IClassName {
+public:
+    struct Feedback {
+        uint64_t seq;
+        MethodType method;
+        string url;
+        JValue payload;
+        // deployment or cancellation action which the feedback is for. (empty if none)
+        string actionId;
+        // 'proceeding' is replaced by the newer one of the same action
+        bool isProceeding;
+    };
+
+    FeedbackOutbox();
+    virtual ~FeedbackOutbox();
+
+    // Replay the journal
+    bool open(const string& path);
+    void close();
+
+    // 'isFrontSending' keeps the front although it is superseded. It is on the wire already.
+    bool push(Feedback& feedback, bool isFrontSending);
+    // The front is delivered (or given up)
+    void pop();
+
+    Feedback& front()
+    {
+        return m_feedbacks.front();
+    }
+
+    bool empty()
+    {
+        return m_feedbacks.empty();
+    }
+
+    size_t size()
+    {
+        return m_feedbacks.size();
+    }
+
+private:
+    static const size_t COMPACT_LINES = 64;
+
+    static string toString(MethodType method);
+    static MethodType toMethodType(const string& method);
+
+    bool append(const JValue& line);
+    // 'isForced' rewrites the journal although it has no acked lines
+    bool compact(bool isForced = false);
+    JValue toJson(Feedback& feedback);
+
+    string m_path;
+    int m_fd;
+    size_t m_lines;
+    uint64_t m_seq;
+    deque<Feedback> m_feedbacks;
+};
+
+#endif /* HAWKBIT_FEEDBACKOUTBOX_H_ */
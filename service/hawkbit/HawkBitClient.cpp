@@ -18,18 +18,26 @@
 
 #include <curl/curl.h>
 #include <glib.h>
+#include <stdlib.h>
 
 #include "PolicyManager.h"
 #include "Setting.h"
 #include "core/HttpRequest.h"
-#include "external/glibcurl.h"
 #include "hawkbit/HawkBitInfo.h"
+#include "hawkbit/PollingScheduler.h"
 #include "util/JValueUtil.h"
 #include "util/Logger.h"
 #include "util/Socket.h"
 #include "util/Time.h"
+#include "util/Util.h"
+
+const int HawkBitClient::MAX_FEEDBACK_RETRY_INTERVAL;
 
 HawkBitClient::HawkBitClient()
+    : m_isPolling(false)
+    , m_isFeedbackScheduled(false)
+    , m_feedbackRetryCount(0)
+    , m_feedbackRetrySrc(0)
 {
     setClassName("HawkBitClient");
 }
@@ -40,50 +48,111 @@ HawkBitClient::~HawkBitClient()
 
 bool HawkBitClient::onInitialization()
 {
-    glibcurl_init();
+    if (!Util::makeDir(PATH_PREFERENCE)) {
+        Logger::error(getClassName(), "mkdir error: " PATH_PREFERENCE);
+    }
+    // Feedbacks which were not delivered before reboot
+    m_outbox.open(PATH_PREFERENCE "/" FILE_FEEDBACK_OUTBOX);
+    sendNextFeedback();
     return true;
 }
 
 bool HawkBitClient::onFinalization()
 {
-    glibcurl_cleanup();
+    m_pollingCall = nullptr;
+    m_feedbackCall = nullptr;
+    if (m_feedbackRetrySrc > 0) {
+        g_source_remove(m_feedbackRetrySrc);
+        m_feedbackRetrySrc = 0;
+    }
+    m_outbox.close();
+    m_cachedResponses.clear();
+    m_feedbackCallbacks.clear();
     return true;
 }
 
 void HawkBitClient::poll()
 {
-    JValue responsePayload;
-    string sleep = "";
-    string href = "";
+    if (m_isPolling) {
+        Logger::info(getClassName(), "Previous polling is in progress. Skipped");
+        return;
+    }
 
     Logger::info(getClassName(), "== POLLING START ==");
-    if (!getBase(responsePayload, HawkBitInfo::getInstance().getBaseUrl())) {
-        goto Done;
+    m_isPolling = true;
+    bool isSent = getBase(HawkBitInfo::getInstance().getBaseUrl(), [this] (bool success, bool isModified, JValue& responsePayload) {
+        if (!success) {
+            finishPolling();
+            return;
+        }
+        onPolledBase(responsePayload, isModified);
+    });
+    if (!isSent) {
+        finishPolling();
     }
+}
+
+void HawkBitClient::onPolledBase(JValue& responsePayload, bool isModified)
+{
+    string sleep = "";
+    string href = "";
 
-    if (JValueUtil::getValue(responsePayload, "config", "polling", "sleep", sleep)) {
-        if (m_listener) m_listener->onPollingSleepAction(15); // TODO Time::toSeconds(sleep));
+    // Same as the previous polling. Its actions are done already.
+    if (isModified && JValueUtil::getValue(responsePayload, "config", "polling", "sleep", sleep)) {
+        if (m_listener) m_listener->onPollingSleepAction(Time::toSeconds(sleep));
     }
 
-    if (JValueUtil::getValue(responsePayload, "_links", "configData", "href", href)) {
+    if (isModified && JValueUtil::getValue(responsePayload, "_links", "configData", "href", href)) {
         if (m_listener) m_listener->onSettingConfigData();
     }
 
     if (JValueUtil::getValue(responsePayload, "_links", "deploymentBase", "href", href)) {
-        if (!getBase(responsePayload, href + "&actionHistory=10")) {
-            goto Done;
+        bool isSent = getBase(href + "&actionHistory=10", [this] (bool success, bool isModified, JValue& responsePayload) {
+            if (!success) {
+                finishPolling();
+                return;
+            }
+            onPolledDeploymentBase(responsePayload, isModified);
+        });
+        if (!isSent) {
+            finishPolling();
         }
-        if (m_listener) m_listener->onInstallationAction(responsePayload);
+        return;
     }
-    if (JValueUtil::getValue(responsePayload, "_links", "cancelAction", "href", href)) {
-        if (!getBase(responsePayload, href)) {
-            goto Done;
+    pollCancelAction(responsePayload);
+}
+
+void HawkBitClient::onPolledDeploymentBase(JValue& responsePayload, bool isModified)
+{
+    if (isModified && m_listener) m_listener->onInstallationAction(responsePayload);
+    pollCancelAction(responsePayload);
+}
+
+void HawkBitClient::pollCancelAction(JValue& responsePayload)
+{
+    string href = "";
+
+    if (!JValueUtil::getValue(responsePayload, "_links", "cancelAction", "href", href)) {
+        finishPolling();
+        return;
+    }
+
+    bool isSent = getBase(href, [this] (bool success, bool isModified, JValue& responsePayload) {
+        if (success && isModified && m_listener) {
+            m_listener->onCancellationAction(responsePayload);
         }
-        if (m_listener) m_listener->onCancellationAction(responsePayload);
+        finishPolling();
+    });
+    if (!isSent) {
+        finishPolling();
     }
+}
 
-Done:
+void HawkBitClient::finishPolling()
+{
+    m_isPolling = false;
     Logger::info(getClassName(), "== POLLING END ==");
+    PollingScheduler::getInstance().schedule();
 }
 
 bool HawkBitClient::canceled(const string& id)
@@ -95,7 +164,7 @@ bool HawkBitClient::canceled(const string& id)
     HttpRequest httpCall;
     httpCall.open(MethodType_POST, url);
 
-    Logger::verbose(getClassName(), "RestAPI", "POST Cancellation Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Cancellation Action");
     return true;
 }
 
@@ -110,7 +179,7 @@ bool HawkBitClient::rejected(const string& id)
     HttpRequest httpCall;
     httpCall.open(MethodType_POST, url);
 
-    Logger::verbose(getClassName(), "RestAPI", "POST Cancellation Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Cancellation Action");
     return true;
 }
 
@@ -121,7 +190,7 @@ bool HawkBitClient::closed(const string& id)
      * Note: DDI defines also a status NONE which will not be interpreted by the update server and handled like SUCCESS.
      */
     const string url = HawkBitInfo::getInstance().getBaseUrl() + "/deploymentBase/" + id + "/feedback";
-    Logger::verbose(getClassName(), "RestAPI", "POST Deployment Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Deployment Action");
 
 //    JValue requestPayload = pbnjson::Object();
 //    requestPayload.put("id", id);
@@ -146,7 +215,7 @@ bool HawkBitClient::proceeding(const string& id, const string& detail)
      * This can be used by the target to inform that it is working on the action.
      */
     const string url = HawkBitInfo::getInstance().getBaseUrl() + "/deploymentBase/" + id + "/feedback";
-    Logger::verbose(getClassName(), "RestAPI", "POST Deployment Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Deployment Action");
     Logger::info(getClassName(), __FUNCTION__, detail);
 
     JValue requestPayload = pbnjson::Object();
@@ -155,12 +224,7 @@ bool HawkBitClient::proceeding(const string& id, const string& detail)
 
     getStatus(requestPayload, "proceeding", "none", detail);
 
-    HttpRequest httpCall;
-    if (!httpCall.open(MethodType_POST, url) || !httpCall.send(requestPayload)) {
-        Logger::error(getClassName(), "Failed to post feedback");
-        return false;
-    }
-    return true;
+    return sendFeedback(MethodType_POST, url, requestPayload, id, true);
 }
 
 bool HawkBitClient::scheduled(const string& id)
@@ -169,7 +233,7 @@ bool HawkBitClient::scheduled(const string& id)
      *  This can be used by the target to inform that it scheduled on the action.
      */
     const string url = HawkBitInfo::getInstance().getBaseUrl() + "/deploymentBase/" + id + "/feedback";
-    Logger::verbose(getClassName(), "RestAPI", "POST Deployment Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Deployment Action");
 
     JValue requestPayload = pbnjson::Object();
     requestPayload.put("id", id);
@@ -194,7 +258,7 @@ bool HawkBitClient::resumed(const string& id)
      * This can be used by the target to inform that it continued to work on the action.
      */
     const string url = HawkBitInfo::getInstance().getBaseUrl() + "/deploymentBase/" + id + "/feedback";
-    Logger::verbose(getClassName(), "RestAPI", "POST Deployment Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Deployment Action");
 
     JValue requestPayload = pbnjson::Object();
     requestPayload.put("id", id);
@@ -205,18 +269,16 @@ bool HawkBitClient::resumed(const string& id)
 //    else
 //        getStatus(requestPayload, "closed", "failure");
 
-    HttpRequest httpCall;
-    if (!httpCall.open(MethodType_POST, url) || !httpCall.send(requestPayload)) {
-        Logger::error(getClassName(), "Failed to post feedback");
-        return false;
-    }
-    return true;
+    return sendFeedback(MethodType_POST, url, requestPayload, id);
 }
 
 bool HawkBitClient::postCancellationAction(const string& id, bool success)
 {
+    // The action is finished here. Next polling should be handled even if it is not modified.
+    m_cachedResponses.clear();
+
     const string url = HawkBitInfo::getInstance().getBaseUrl() + "/cancelAction/" + id + "/feedback";
-    Logger::verbose(getClassName(), "RestAPI", "POST Deployment Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Deployment Action");
 
     JValue requestPayload = pbnjson::Object();
     requestPayload.put("id", id);
@@ -227,18 +289,16 @@ bool HawkBitClient::postCancellationAction(const string& id, bool success)
     else
         getStatus(requestPayload, "closed", "failure");
 
-    HttpRequest httpCall;
-    if (!httpCall.open(MethodType_POST, url) || !httpCall.send(requestPayload)) {
-        Logger::error(getClassName(), "Failed to post feedback");
-        return false;
-    }
-    return true;
+    return sendFeedback(MethodType_POST, url, requestPayload, id);
 }
 
 bool HawkBitClient::postDeploymentAction(const string& id, bool success)
 {
+    // The action is finished here. Next polling should be handled even if it is not modified.
+    m_cachedResponses.clear();
+
     const string url = HawkBitInfo::getInstance().getBaseUrl() + "/deploymentBase/" + id + "/feedback";
-    Logger::verbose(getClassName(), "RestAPI", "POST Deployment Action");
+    LOG_VERBOSE(getClassName(), "RestAPI", "POST Deployment Action");
 
     JValue requestPayload = pbnjson::Object();
     requestPayload.put("id", id);
@@ -249,15 +309,10 @@ bool HawkBitClient::postDeploymentAction(const string& id, bool success)
     else
         getStatus(requestPayload, "closed", "failure");
 
-    HttpRequest httpCall;
-    if (!httpCall.open(MethodType_POST, url) || !httpCall.send(requestPayload)) {
-        Logger::error(getClassName(), "Failed to post feedback");
-        return false;
-    }
-    return true;
+    return sendFeedback(MethodType_POST, url, requestPayload, id);
 }
 
-bool HawkBitClient::putConfigData(JValue& data)
+bool HawkBitClient::putConfigData(JValue& data, FeedbackCallback callback)
 {
     const string url = HawkBitInfo::getInstance().getBaseUrl() + "/configData";
 
@@ -267,32 +322,68 @@ bool HawkBitClient::putConfigData(JValue& data)
 
     getStatus(requestPayload, "closed", "success");
 
-    HttpRequest httpCall;
-    if (!httpCall.open(MethodType_PUT, url) || !httpCall.send(requestPayload)) {
-        Logger::error(getClassName(), "Failed to put config data");
-        return false;
-    }
-    return true;
+    return sendFeedback(MethodType_PUT, url, requestPayload, "", false, callback);
 }
 
-bool HawkBitClient::getBase(JValue& responsePayload, const string& url)
+bool HawkBitClient::getBase(const string& url, GetBaseCallback callback)
 {
-    HttpRequest httpCall;
+    m_pollingCall = make_shared<HttpRequest>();
 
-    Logger::verbose(getClassName(), "RestAPI", "GET " + url);
-    if (!httpCall.open(MethodType_GET, url) || !httpCall.send()) {
-        Logger::error(getClassName(), "Failed to perform HttpCall");
+    LOG_VERBOSE(getClassName(), "RestAPI", "GET " + url);
+    if (!m_pollingCall->open(MethodType_GET, url)) {
+        Logger::error(getClassName(), "Failed to open HttpCall");
         return false;
     }
+    auto cached = m_cachedResponses.find(url);
+    if (cached != m_cachedResponses.end()) {
+        m_pollingCall->setCacheValidators(cached->second.etag, cached->second.lastModified);
+    }
+
+    bool isSent = m_pollingCall->sendAsync([this, url, callback] (HttpRequest* httpCall) {
+        JValue responsePayload;
+        if (httpCall->getResult() != CURLE_OK) {
+            Logger::error(getClassName(), "Failed to perform HttpCall");
+            PollingScheduler::getInstance().onResponse(0L, 0);
+            callback(false, false, responsePayload);
+            return;
+        }
 
-    long responseCode = httpCall.getStatus();
-    if (responseCode != 200L) {
-        Logger::error(getClassName(), HttpRequest::toString(responseCode));
+        long responseCode = httpCall->getStatus();
+        PollingScheduler::getInstance().onResponse(responseCode, atoi(httpCall->getResponseHeader("retry-after").c_str()));
+        auto cached = m_cachedResponses.find(url);
+        if (responseCode == 304L && cached != m_cachedResponses.end()) {
+            LOG_VERBOSE(getClassName(), "Not modified : " + url);
+            responsePayload = cached->second.payload;
+            callback(true, false, responsePayload);
+            return;
+        }
+        if (responseCode != 200L) {
+            Logger::error(getClassName(), HttpRequest::toString(responseCode));
+            callback(false, false, responsePayload);
+            return;
+        }
+
+        responsePayload = JDomParser::fromString(httpCall->getResponseText());
+        LOG_VERBOSE(getClassName(), "Response : \n" + responsePayload.stringify("    "));
+
+        CachedResponse response;
+        response.etag = httpCall->getResponseHeader("etag");
+        response.lastModified = httpCall->getResponseHeader("last-modified");
+        if (response.etag.empty() && response.lastModified.empty()) {
+            m_cachedResponses.erase(url);
+        } else {
+            // URLs of deploymentBase change with actions. Old ones are not polled again.
+            if (cached == m_cachedResponses.end() && m_cachedResponses.size() >= MAX_CACHED_RESPONSES)
+                m_cachedResponses.clear();
+            response.payload = responsePayload;
+            m_cachedResponses[url] = response;
+        }
+        callback(true, true, responsePayload);
+    });
+    if (!isSent) {
+        Logger::error(getClassName(), "Failed to perform HttpCall");
         return false;
     }
-
-    responsePayload = JDomParser::fromString(httpCall.getResponseText());
-    Logger::verbose(getClassName(), "Response : \n" + responsePayload.stringify("    "));
     return true;
 }
 
@@ -311,3 +402,119 @@ void HawkBitClient::getStatus(JValue& json, const string& execution, const strin
 
     json.put("status", status);
 }
+
+bool HawkBitClient::sendFeedback(const MethodType& methodType, const string& url, JValue& requestPayload, const string& actionId, bool isProceeding, FeedbackCallback callback)
+{
+    FeedbackOutbox::Feedback feedback;
+    feedback.method = methodType;
+    feedback.url = url;
+    feedback.payload = requestPayload.duplicate();
+    feedback.actionId = actionId;
+    feedback.isProceeding = isProceeding;
+    if (!m_outbox.push(feedback, m_feedbackCall != nullptr)) {
+        Logger::warning(getClassName(), "Feedback is not saved. It is lost if the service is stopped");
+    }
+    if (callback)
+        m_feedbackCallbacks[feedback.seq] = callback;
+
+    // Feedbacks of the same turn of the main loop are sent together. Superseded ones are dropped before that.
+    if (!m_isFeedbackScheduled) {
+        m_isFeedbackScheduled = true;
+        Util::async([this] {
+            m_isFeedbackScheduled = false;
+            sendNextFeedback();
+        });
+    }
+    return true;
+}
+
+void HawkBitClient::sendNextFeedback()
+{
+    // In progress, or waiting to retry
+    if (m_feedbackCall || m_feedbackRetrySrc > 0)
+        return;
+
+    while (!m_outbox.empty()) {
+        FeedbackOutbox::Feedback& feedback = m_outbox.front();
+        m_feedbackCall = make_shared<HttpRequest>();
+        if (!m_feedbackCall->open(feedback.method, feedback.url)) {
+            Logger::error(getClassName(), "Invalid feedback. Dropped", feedback.url);
+            uint64_t seq = feedback.seq;
+            m_feedbackCall = nullptr;
+            m_outbox.pop();
+            notifyFeedback(seq, false, false);
+            continue;
+        }
+        bool isSent = m_feedbackCall->sendAsync([this] (HttpRequest* httpCall) {
+            onSentFeedback(httpCall);
+        }, feedback.payload);
+        if (isSent) {
+            return;
+        }
+        Logger::error(getClassName(), "Failed to post feedback");
+        m_feedbackCall = nullptr;
+        notifyFeedback(feedback.seq, false, true);
+        retryFeedback();
+        return;
+    }
+}
+
+void HawkBitClient::onSentFeedback(HttpRequest* httpCall)
+{
+    CURLcode result = httpCall->getResult();
+    long responseCode = httpCall->getStatus();
+    uint64_t seq = m_outbox.front().seq;
+    // 'httpCall' is released here
+    m_feedbackCall = nullptr;
+
+    if (result == CURLE_OK && responseCode >= 200L && responseCode < 300L) {
+        m_feedbackRetryCount = 0;
+        m_outbox.pop();
+        notifyFeedback(seq, true, false);
+        sendNextFeedback();
+        return;
+    }
+    if (result == CURLE_OK && responseCode >= 400L && responseCode < 500L && responseCode != 408L && responseCode != 429L) {
+        // The server doesn't accept it. (i.e. the action is gone) Retrying doesn't help.
+        Logger::error(getClassName(), "Feedback is rejected. Dropped", HttpRequest::toString(responseCode));
+        m_outbox.pop();
+        notifyFeedback(seq, false, false);
+        sendNextFeedback();
+        return;
+    }
+    Logger::warning(getClassName(), "Failed to post feedback", HttpRequest::toString(responseCode));
+    notifyFeedback(seq, false, true);
+    retryFeedback();
+}
+
+void HawkBitClient::notifyFeedback(uint64_t seq, bool isDelivered, bool isRetrying)
+{
+    auto it = m_feedbackCallbacks.find(seq);
+    if (it == m_feedbackCallbacks.end())
+        return;
+
+    // only once
+    FeedbackCallback callback = it->second;
+    m_feedbackCallbacks.erase(it);
+    callback(isDelivered, isRetrying);
+}
+
+void HawkBitClient::retryFeedback()
+{
+    int interval = FEEDBACK_RETRY_INTERVAL;
+    for (int i = 0; i < m_feedbackRetryCount && interval < MAX_FEEDBACK_RETRY_INTERVAL; i++)
+        interval *= 2;
+    interval = min(interval, MAX_FEEDBACK_RETRY_INTERVAL);
+    m_feedbackRetryCount++;
+
+    Logger::info(getClassName(), "Retry " + to_string(m_outbox.size()) + " feedbacks after " + to_string(interval) + "s");
+    m_feedbackRetrySrc = g_timeout_add_seconds(interval, onRetryFeedback, this);
+}
+
+gboolean HawkBitClient::onRetryFeedback(gpointer data)
+{
+    HawkBitClient* self = (HawkBitClient*) data;
+    self->m_feedbackRetrySrc = 0;
+    self->sendNextFeedback();
+    return G_SOURCE_REMOVE;
+}
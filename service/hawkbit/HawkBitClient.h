@@ -17,9 +17,13 @@
 #ifndef HAWKBIT_HAWKBITCLIENT_H_
 #define HAWKBIT_HAWKBITCLIENT_H_
 
+#include <deque>
+#include <functional>
+#include <map>
 #include <pbnjson.hpp>
 
 #include "core/HttpRequest.h"
+#include "hawkbit/FeedbackOutbox.h"
 #include "interface/IInitializable.h"
 #include "interface/IListener.h"
 #include "interface/ISingleton.h"
@@ -42,6 +46,9 @@ class HawkBitClient : public IInitializable,
                       public ISingleton<HawkBitClient> {
 friend ISingleton<HawkBitClient>;
 public:
+    // Called when the feedback is delivered, or when the first try fails. 'isRetrying' if it is still in the outbox.
+    typedef function<void(bool isDelivered, bool isRetrying)> FeedbackCallback;
+
     virtual ~HawkBitClient();
 
     // IInitializable
@@ -61,14 +68,55 @@ public:
     // HackBit communication APIs
     bool postCancellationAction(const string& id, bool success);
     bool postDeploymentAction(const string& id, bool success);
-    bool putConfigData(JValue& data);
+    bool putConfigData(JValue& data, FeedbackCallback callback = nullptr);
 
 private:
+    // Called with 'false' if the request is failed or the response is not '200 OK'.
+    // 'isModified' is false if the server answered '304 Not Modified'. Then 'responsePayload' is the cached one.
+    typedef function<void(bool success, bool isModified, JValue& responsePayload)> GetBaseCallback;
+
+    struct CachedResponse {
+        string etag;
+        string lastModified;
+        JValue payload;
+    };
+
+    static const size_t MAX_CACHED_RESPONSES = 16;
+
     HawkBitClient();
 
-    bool getBase(JValue& responsePayload, const string& url);
+    void onPolledBase(JValue& responsePayload, bool isModified);
+    void onPolledDeploymentBase(JValue& responsePayload, bool isModified);
+    void pollCancelAction(JValue& responsePayload);
+    void finishPolling();
+
+    bool getBase(const string& url, GetBaseCallback callback);
     void getStatus(JValue& json, const string& execution, const string& finished, string detail = "");
 
+    // Feedbacks are saved in the outbox first, and sent one by one to keep the order of them on the server.
+    // Nothing waits for the network. Failed ones are retried later, even after reboot.
+    bool sendFeedback(const MethodType& methodType, const string& url, JValue& requestPayload, const string& actionId = "", bool isProceeding = false, FeedbackCallback callback = nullptr);
+    void sendNextFeedback();
+    void notifyFeedback(uint64_t seq, bool isDelivered, bool isRetrying);
+    void onSentFeedback(HttpRequest* httpCall);
+    void retryFeedback();
+    static gboolean onRetryFeedback(gpointer data);
+
+    static const int FEEDBACK_RETRY_INTERVAL = 5;
+    static const int MAX_FEEDBACK_RETRY_INTERVAL = 5 * 60;
+
+    bool m_isPolling;
+    shared_ptr<HttpRequest> m_pollingCall;
+    FeedbackOutbox m_outbox;
+    shared_ptr<HttpRequest> m_feedbackCall;
+    bool m_isFeedbackScheduled;
+    int m_feedbackRetryCount;
+    guint m_feedbackRetrySrc;
+    // by 'seq' of the feedback
+    map<uint64_t, FeedbackCallback> m_feedbackCallbacks;
+    // responses of polling by URL. They are validated with 'If-None-Match' / 'If-Modified-Since'
+    map<string, CachedResponse> m_cachedResponses;
+
 };
 
 #endif /* HAWKBIT_HAWKBITCLIENT_H_ */
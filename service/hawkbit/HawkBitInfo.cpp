@@ -42,6 +42,8 @@ bool HawkBitInfo::onInitialization()
         json["address"].asString(m_address);
         json["token"].asString(m_token);
         json["tenant"].asString(m_tenant);
+        if (json.hasKey("downloadPolicy") && json["downloadPolicy"].isObject())
+            m_downloadPolicy = json["downloadPolicy"].duplicate();
     }
 
     if (m_deviceId.empty()) {
@@ -90,3 +92,17 @@ bool HawkBitInfo::onFinalization()
 {
     return true;
 }
+
+bool HawkBitInfo::setDownloadPolicy(const JValue& downloadPolicy)
+{
+    JValue json = JDomParser::fromFile(PATH_PREFERENCE "/" FILE_HAWKBIT_INFO);
+    if (!json.isObject())
+        json = pbnjson::Object();
+    json.put("downloadPolicy", downloadPolicy.duplicate());
+    if (!Util::writeFile(PATH_PREFERENCE "/" FILE_HAWKBIT_INFO, json.stringify("    "))) {
+        Logger::error(getClassName(), "file write error: " PATH_PREFERENCE "/" FILE_HAWKBIT_INFO);
+        return false;
+    }
+    m_downloadPolicy = downloadPolicy.duplicate();
+    return true;
+}
@@ -60,6 +60,12 @@ public:
     {
         return getAddress() + "/" + getTenant() + "/controller/v1/" + getDeviceId();
     }
+    JValue getDownloadPolicy()
+    {
+        return m_downloadPolicy;
+    }
+    // saved with other info
+    bool setDownloadPolicy(const JValue& downloadPolicy);
 
 private:
     HawkBitInfo();
@@ -70,6 +76,7 @@ private:
     string m_address;
     string m_tenant;
     string m_token;
+    JValue m_downloadPolicy;
 };
 
 #endif /* HAWKBIT_HAWKBITINFO_H_ */
@@ -0,0 +1,139 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "hawkbit/PollingScheduler.h"
+
+#include "hawkbit/HawkBitClient.h"
+#include "hawkbit/HawkBitInfo.h"
+#include "util/Logger.h"
+
+const int PollingScheduler::ACTIVE_INTERVAL;
+const int PollingScheduler::MAX_BACKOFF_INTERVAL;
+
+PollingScheduler::PollingScheduler()
+    : m_serverInterval(DEFAULT_INTERVAL)
+    , m_isActive(false)
+    , m_backoffCount(0)
+    , m_retryAfter(0)
+    , m_timerSrc(0)
+{
+    setClassName("PollingScheduler");
+}
+
+PollingScheduler::~PollingScheduler()
+{
+}
+
+bool PollingScheduler::onInitialization()
+{
+    schedule();
+    return true;
+}
+
+bool PollingScheduler::onFinalization()
+{
+    if (m_timerSrc > 0) {
+        g_source_remove(m_timerSrc);
+        m_timerSrc = 0;
+    }
+    return true;
+}
+
+void PollingScheduler::setServerInterval(int seconds)
+{
+    if (seconds <= 0 || m_serverInterval == seconds)
+        return;
+
+    Logger::info(getClassName(), "Polling interval : " + to_string(seconds) + "s");
+    m_serverInterval = seconds;
+}
+
+void PollingScheduler::setActive(bool isActive)
+{
+    if (m_isActive == isActive)
+        return;
+
+    Logger::info(getClassName(), isActive ? "Fast polling" : "Normal polling");
+    m_isActive = isActive;
+    // Don't wait the long interval to see the next step of the action
+    if (isActive)
+        schedule();
+}
+
+void PollingScheduler::onResponse(long responseCode, int retryAfter)
+{
+    if (responseCode == 429L || (responseCode >= 500L && responseCode < 600L)) {
+        if (m_backoffCount < MAX_BACKOFF_COUNT)
+            m_backoffCount++;
+        m_retryAfter = max(m_retryAfter, retryAfter);
+        Logger::warning(getClassName(), "Server is busy (" + to_string(responseCode) + "). Backoff " + to_string(m_backoffCount));
+    } else if (responseCode > 0L) {
+        // Network failures (0) don't tell anything about the server
+        m_backoffCount = 0;
+        m_retryAfter = 0;
+    }
+}
+
+void PollingScheduler::schedule()
+{
+    int interval = m_isActive ? min(ACTIVE_INTERVAL, m_serverInterval) : m_serverInterval;
+    if (m_backoffCount > 0) {
+        // The server interval is the base of backoff, even while an action is active
+        interval = m_serverInterval;
+        for (int i = 0; i < m_backoffCount && interval < MAX_BACKOFF_INTERVAL; i++)
+            interval *= 2;
+        interval = max(min(interval, MAX_BACKOFF_INTERVAL), m_retryAfter);
+    }
+    interval += getJitter(interval);
+
+    if (m_timerSrc > 0) {
+        g_source_remove(m_timerSrc);
+        m_timerSrc = 0;
+    }
+    m_timerSrc = g_timeout_add_seconds(interval, onTimeout, this);
+    LOG_VERBOSE(getClassName(), "Next polling after " + to_string(interval) + "s");
+}
+
+gboolean PollingScheduler::onTimeout(gpointer data)
+{
+    PollingScheduler* self = (PollingScheduler*) data;
+    self->m_timerSrc = 0;
+    // The next polling is scheduled when this polling is finished
+    HawkBitClient::getInstance().poll();
+    return G_SOURCE_REMOVE;
+}
+
+uint32_t PollingScheduler::hash(const string& str)
+{
+    // FNV-1a. It should be same on every device and every build.
+    uint32_t value = 2166136261u;
+    for (char c : str) {
+        value ^= (uint8_t) c;
+        value *= 16777619u;
+    }
+    return value;
+}
+
+int PollingScheduler::getJitter(int interval)
+{
+    int range = interval / JITTER_DIVISOR;
+    if (range <= 0)
+        return 0;
+    // Same device gets same jitter, but retries of backoff are spread again
+    uint32_t value = hash(HawkBitInfo::getInstance().getDeviceId() + "/" + to_string(m_backoffCount));
+    return (int) (value % (uint32_t) (range + 1));
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef HAWKBIT_POLLINGSCHEDULER_H_
+#define HAWKBIT_POLLINGSCHEDULER_H_
+
+#include <iostream>
+#include <glib.h>
+#include <stdint.h>
+
+#include "interface/IInitializable.h"
+#include "interface/ISingleton.h"
+
+using namespace std;
+
+// Decides when HawkBitClient polls next.
+// The interval comes from the server ('config.polling.sleep'), and it is shorter while an action is active.
+// Each device waits a bit more by its own jitter derived from 'deviceId', so devices don't poll in lockstep.
+// '429' or '5xx' doubles the interval until the server answers normally again.
+class PollingScheduler : public IInitializable,
+                         public ISingleton<PollingScheduler> {
+friend class ISingleton<PollingScheduler>;
+public:
+    virtual ~PollingScheduler();
+
+    // IInitializable
+    virtual bool onInitialization() override;
+    virtual bool onFinalization() override;
+
+    // 'config.polling.sleep' of the server
+    void setServerInterval(int seconds);
+    // Poll fast while an action is in progress
+    void setActive(bool isActive);
+    // Result of each request while polling. 'retryAfter' is 'Retry-After' header in seconds. (0 if none)
+    void onResponse(long responseCode, int retryAfter);
+    // Start the timer for the next polling. It replaces the pending one.
+    void schedule();
+
+private:
+    static const int DEFAULT_INTERVAL = 15;
+    static const int ACTIVE_INTERVAL = 15;
+    static const int MAX_BACKOFF_INTERVAL = 60 * 60;
+    static const int MAX_BACKOFF_COUNT = 16;
+    // jitter is up to 1/JITTER_DIVISOR of the interval
+    static const int JITTER_DIVISOR = 5;
+
+    static gboolean onTimeout(gpointer data);
+    static uint32_t hash(const string& str);
+
+    PollingScheduler();
+
+    int getJitter(int interval);
+
+    int m_serverInterval;
+    bool m_isActive;
+    // consecutive '429' or '5xx'
+    int m_backoffCount;
+    int m_retryAfter;
+    guint m_timerSrc;
+};
+
+#endif /* HAWKBIT_POLLINGSCHEDULER_H_ */
@@ -27,20 +27,69 @@
 #include "ls2/SettingsService.h"
 #include "ls2/SystemService.h"
 #include "util/Logger.h"
+#include "util/Util.h"
 
 const unsigned long LS2Handler::LSCALL_TIMEOUT = 5000;
 const string LS2Handler::NAME = NAME_SWUPDATER;
-const LSMethod LS2Handler::ROOT_METHODS[] = {
-    { "getStatus", LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE },
-    { "startDownload", LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE },
-    { "pauseDownload", LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE },
-    { "resumeDownload", LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE },
-    { "cancelDownload", LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE },
-    { "startInstall", LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE },
-    { "cancelInstall", LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE },
-    { 0, 0, LUNA_METHOD_FLAGS_NONE }
+const LS2Handler::Method LS2Handler::ROOT_METHODS[] = {
+    { "getStatus", &LS2HandlerListener::onGetStatus,
+      R"({"type":"object","properties":{"subscribe":{"type":"boolean"},"delta":{"type":"boolean"}}})" },
+    { "setConfig", &LS2HandlerListener::onSetConfig,
+      R"({"type":"object","properties":{"data":{"type":"object"}},"required":["data"]})" },
+    { "startDownload", &LS2HandlerListener::onStartDownload, nullptr },
+    { "pauseDownload", &LS2HandlerListener::onPauseDownload, nullptr },
+    { "resumeDownload", &LS2HandlerListener::onResumeDownload, nullptr },
+    { "cancelDownload", &LS2HandlerListener::onCancelDownload, nullptr },
+    { "startInstall", &LS2HandlerListener::onStartInstall, nullptr },
+    { "cancelInstall", &LS2HandlerListener::onCancelInstall, nullptr },
+    { "setDownloadPolicy", &LS2HandlerListener::onSetDownloadPolicy,
+      R"({"type":"object","properties":{)"
+      R"("maxRate":{"type":"integer","minimum":0},)"
+      R"("adaptive":{"type":"boolean"},)"
+      R"("adaptiveRate":{"type":"integer","minimum":1},)"
+      R"("foregroundThreshold":{"type":"integer","minimum":1},)"
+      R"("windows":{"type":"array","items":{"type":"object","properties":{)"
+      R"("start":{"type":"string","pattern":"^([01][0-9]|2[0-3]):[0-5][0-9]$"},)"
+      R"("end":{"type":"string","pattern":"^([01][0-9]|2[0-3]):[0-5][0-9]$"}},)"
+      R"("required":["start","end"],"additionalProperties":false}}}})" },
+    { nullptr, nullptr, nullptr }
 };
 
+LS2DeferredResponse::LS2DeferredResponse(LS::Message& request, JValue& requestPayload)
+    : m_request(request)
+    , m_requestPayload(requestPayload)
+    , m_isCompleted(false)
+{
+}
+
+LS2DeferredResponse::~LS2DeferredResponse()
+{
+    if (!m_isCompleted) {
+        JValue responsePayload = pbnjson::Object();
+        responsePayload.put("errorText", "Request is dropped");
+        complete(responsePayload);
+    }
+}
+
+void LS2DeferredResponse::complete(JValue responsePayload)
+{
+    if (m_isCompleted.exchange(true))
+        return;
+
+    // LS2 responses are sent in the main loop
+    LS::Message request = m_request;
+    JValue requestPayload = m_requestPayload;
+    Util::async([request, requestPayload, responsePayload] () mutable {
+        LS2Handler::after(request, requestPayload, responsePayload);
+    });
+}
+
+shared_ptr<LS2DeferredResponse> LS2Handler::defer(LS::Message& request, JValue& requestPayload)
+{
+    LS2Handler::getInstance().m_isDeferred = true;
+    return make_shared<LS2DeferredResponse>(request, requestPayload);
+}
+
 bool LS2Handler::onRequest(LSHandle *sh, LSMessage *msg, void *category_context)
 {
     // All LS2 requests are handled in queue
@@ -70,34 +119,27 @@ bool LS2Handler::handleRequest()
         LS::Message request = LS2Handler::getInstance().m_requests.front();
         LS2Handler::getInstance().m_requests.pop();
 
-        // pre processing before request handling
-        before(request, requestPayload, responsePayload);
-        string kind = request.getKind();
+        // pre processing before request handling. The payload is parsed once with the schema of the method.
+        auto method = m_methods.find(request.getKind());
+        bool hasSchema = (method != m_methods.end() && method->second.first->schema);
+        before(request, hasSchema ? method->second.second : JSchema::AllSchema(), requestPayload, responsePayload);
+        m_isDeferred = false;
 
         if (requestPayload.isNull()) {
-            responsePayload.put("errorText", "Json parsing error");
-        } else if (LS2Handler::getInstance().m_listener == nullptr) {
+            responsePayload.put("errorText", hasSchema ? "Invalid parameters" : "Json parsing error");
+        } else if (m_listener == nullptr) {
             responsePayload.put("errorText", "API handler is null");
         } else if (!HawkBitInfo::getInstance().isHawkBitInfoSet()) {
             responsePayload.put("errorText", "HawkBitInfo is NOT set");
-        } else if (kind == "/getStatus") {
-            PolicyManager::getInstance().onGetStatus(request, requestPayload, responsePayload);
-        } else if (kind == "/setConfig") {
-            PolicyManager::getInstance().onSetConfig(request, requestPayload, responsePayload);
-        } else if (kind == "/startDownload") {
-            PolicyManager::getInstance().onStartDownload(request, requestPayload, responsePayload);
-        } else if (kind == "/pauseDownload") {
-            PolicyManager::getInstance().onPauseDownload(request, requestPayload, responsePayload);
-        } else if (kind == "/resumeDownload") {
-            PolicyManager::getInstance().onResumeDownload(request, requestPayload, responsePayload);
-        } else if (kind == "/cancelDownload") {
-            PolicyManager::getInstance().onCancelDownload(request, requestPayload, responsePayload);
-        } else if (kind == "/startInstall") {
-            PolicyManager::getInstance().onStartInstall(request, requestPayload, responsePayload);
-        } else if (kind == "/cancelInstall") {
-            PolicyManager::getInstance().onCancelInstall(request, requestPayload, responsePayload);
-        } else {
+        } else if (method == m_methods.end()) {
             responsePayload.put("errorText", "Please extend API handlers");
+        } else {
+            (m_listener->*(method->second.first->handler))(request, requestPayload, responsePayload);
+        }
+
+        if (m_isDeferred) {
+            writeALog("Deferred", request, requestPayload);
+            continue;
         }
         after(request, requestPayload, responsePayload);
     }
@@ -107,9 +149,16 @@ bool LS2Handler::handleRequest()
 
 LS2Handler::LS2Handler()
     : Handle(LS::registerService(NAME.c_str()))
+    , m_isDeferred(false)
 {
     setClassName("LS2Handler");
-    this->registerCategory("/", ROOT_METHODS, NULL, NULL);
+    for (const Method* method = ROOT_METHODS; method->name; method++) {
+        m_lsMethods.push_back({ method->name, LS2Handler::onRequest, LUNA_METHOD_FLAGS_NONE });
+        JSchema schema = method->schema ? JSchema::fromString(method->schema) : JSchema::AllSchema();
+        m_methods.emplace("/" + string(method->name), make_pair(method, schema));
+    }
+    m_lsMethods.push_back({ nullptr, nullptr, LUNA_METHOD_FLAGS_NONE });
+    this->registerCategory("/", m_lsMethods.data(), NULL, NULL);
 }
 
 LS2Handler::~LS2Handler()
@@ -139,9 +188,9 @@ bool LS2Handler::onFinalization()
     return true;
 }
 
-void LS2Handler::before(LS::Message& request, JValue& requestPayload, JValue& responsePayload)
+void LS2Handler::before(LS::Message& request, const JSchema& schema, JValue& requestPayload, JValue& responsePayload)
 {
-    requestPayload = JDomParser::fromString(request.getPayload());
+    requestPayload = JDomParser::fromString(request.getPayload(), schema);
     responsePayload = pbnjson::Object();
 
     writeALog("Request", request, requestPayload);
@@ -162,25 +211,31 @@ void LS2Handler::after(LS::Message& request, JValue& requestPayload, JValue& res
 
 void LS2Handler::writeALog(const string& type, LS::Message& request, JValue& payload)
 {
+    if (!Logger::getInstance().isEnabled(LogLevel_DEBUG))
+        return;
+
     string log = request.getKind();
     log += " - " + string(request.getSenderServiceName() ? request.getSenderServiceName() : request.getApplicationID());
 
     if (Logger::getInstance().isVerbose()) {
         log += "\n" + payload.stringify("    ");
-        Logger::verbose(NAME, type, log);
+        LOG_VERBOSE(NAME, type, log);
     } else {
-        Logger::debug(NAME, type, log);
+        LOG_DEBUG(NAME, type, log);
     }
 }
 
 void LS2Handler::writeBLog(const string& type, const string& kind, JValue& payload)
 {
+    if (!Logger::getInstance().isEnabled(LogLevel_DEBUG))
+        return;
+
     string log = kind;
 
     if (Logger::getInstance().isVerbose()) {
         log += "\n" + payload.stringify("    ");
-        Logger::verbose(NAME, type, log);
+        LOG_VERBOSE(NAME, type, log);
     } else {
-        Logger::debug(NAME, type, log);
+        LOG_DEBUG(NAME, type, log);
     }
 }
@@ -17,8 +17,12 @@
 #ifndef _MANAGER_UPDATEMANAGER_H_
 #define _MANAGER_UPDATEMANAGER_H_
 
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <queue>
+#include <vector>
 #include <boost/signals2.hpp>
 
 #include <luna-service2/lunaservice.hpp>
@@ -45,6 +49,22 @@ public:
     virtual void onCancelDownload(LS::Message& request, JValue& requestPayload, JValue& responsePayload) = 0;
     virtual void onStartInstall(LS::Message& request, JValue& requestPayload, JValue& responsePayload) = 0;
     virtual void onCancelInstall(LS::Message& request, JValue& requestPayload, JValue& responsePayload) = 0;
+    virtual void onSetDownloadPolicy(LS::Message& request, JValue& requestPayload, JValue& responsePayload) = 0;
+};
+
+// Response which is sent after the handler returns. (i.e. when a slow backend replies)
+// It can be completed on any thread. If it is released without completion, an error is responded.
+class LS2DeferredResponse {
+public:
+    LS2DeferredResponse(LS::Message& request, JValue& requestPayload);
+    virtual ~LS2DeferredResponse();
+
+    void complete(JValue responsePayload);
+
+private:
+    LS::Message m_request;
+    JValue m_requestPayload;
+    atomic<bool> m_isCompleted;
 };
 
 class LS2Handler : public Handle,
@@ -52,7 +72,11 @@ class LS2Handler : public Handle,
                    public IListener<LS2HandlerListener>,
                    public ISingleton<LS2Handler> {
 friend ISingleton<LS2Handler>;
+friend LS2DeferredResponse;
 public:
+    // Called by a handler instead of filling 'responsePayload'. The next request is handled without waiting.
+    static shared_ptr<LS2DeferredResponse> defer(LS::Message& request, JValue& requestPayload);
+
     static void writeALog(const string& type, LS::Message& request, JValue& payload);
     static void writeBLog(const string& type, const string& kind, JValue& payload);
 
@@ -65,9 +89,19 @@ public:
     virtual bool onFinalization() override;
 
 private:
+    typedef void (LS2HandlerListener::*Handler)(LS::Message& request, JValue& requestPayload, JValue& responsePayload);
+
+    struct Method {
+        const char* name;
+        Handler handler;
+        // JSON schema of the request payload. (nullptr if any payload is allowed)
+        const char* schema;
+    };
+
     static bool onRequest(LSHandle* sh, LSMessage* msg, void* category_context);
 
-    static void before(LS::Message& request, JValue& requestPayload, JValue& responsePayload);
+    // 'requestPayload' is null if the payload isn't valid for 'schema'
+    static void before(LS::Message& request, const JSchema& schema, JValue& requestPayload, JValue& responsePayload);
     static void after(LS::Message& request, JValue& requestPayload, JValue& responsePayload);
 
     LS2Handler();
@@ -75,9 +109,14 @@ private:
     bool handleRequest();
 
     static const string NAME;
-    static const LSMethod ROOT_METHODS[];
+    static const Method ROOT_METHODS[];
+
+    // built from ROOT_METHODS
+    vector<LSMethod> m_lsMethods;
+    map<string, pair<const Method*, JSchema>> m_methods;
 
     queue<LS::Message> m_requests;
+    bool m_isDeferred;
     boost::signals2::connection m_connection;
 
 };
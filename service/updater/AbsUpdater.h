@@ -17,8 +17,12 @@
 #ifndef UPDATER_ABSUPDATER_H_
 #define UPDATER_ABSUPDATER_H_
 
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <stdint.h>
 
+#include "interface/IClassName.h"
 #include "interface/IInitializable.h"
 #include "interface/ISingleton.h"
 
@@ -30,13 +34,56 @@ enum PartitionLabel {
     PartitionLabel_SYSTEM,
 };
 
+// Progress of 'deploy'. The unit of 'current' and 'total' depends on the updater.
+typedef function<void(uint64_t current, uint64_t total)> DeployProgressCallback;
+
+// Options of 'deploy' or a stream. Each install has its own.
+struct DeployOptions {
+    DeployOptions() : isCompareWrite(false) {}
+
+    // It is called on the thread of 'deploy'
+    DeployProgressCallback progressCallback;
+    // Read the partition first and write only the blocks which are different
+    bool isCompareWrite;
+};
+
+// Result of 'deploy' or a stream
+struct DeployResult {
+    DeployResult() : error(0), writtenBlocks(0), skippedBlocks(0) {}
+
+    // errno of the first write failure. 0 if it failed for other reasons.
+    int error;
+    // blocks which are written / skipped in compare mode
+    uint64_t writtenBlocks;
+    uint64_t skippedBlocks;
+};
+
+// Writes an image to its partition while it is being downloaded
+class AbsUpdateStream : public IClassName {
+public:
+    virtual ~AbsUpdateStream() {}
+
+    // It returns false if the data cannot be written. The stream is unusable after that.
+    virtual bool write(const char* data, size_t size) = 0;
+    // Flush the remaining data. The image is installed only if it returns true.
+    virtual bool finish(DeployResult& result) = 0;
+
+protected:
+    AbsUpdateStream() {}
+};
+
 class AbsUpdater : public IInitializable,
                    public ISingleton<AbsUpdater> {
 friend ISingleton<AbsUpdater>;
 public:
     virtual ~AbsUpdater() {}
 
-    virtual bool deploy(const string& path, PartitionLabel partLabel = PartitionLabel_NONE) = 0;
+    virtual bool deploy(const string& path, PartitionLabel partLabel, const DeployOptions& options, DeployResult& result) = 0;
+    // Streaming install is optional. nullptr means that the file should be downloaded first.
+    virtual shared_ptr<AbsUpdateStream> openStream(const string& filename, PartitionLabel partLabel, const DeployOptions& options)
+    {
+        return nullptr;
+    }
     virtual bool undeploy() = 0;
     virtual bool setReadWriteMode() = 0;
     virtual bool isUpdated() = 0;
@@ -60,7 +107,7 @@ public:
         return true;
     }
 
-    virtual bool deploy(const string& path, PartitionLabel partLabel) override
+    virtual bool deploy(const string& path, PartitionLabel partLabel, const DeployOptions& options, DeployResult& result) override
     {
         return true;
     }
@@ -0,0 +1,208 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "updater/block/BlockStream.h"
+
+#include <string.h>
+
+#include "util/Logger.h"
+
+ImageFormat BlockStream::toImageFormat(const string& filename)
+{
+    string extension = filename.substr(filename.find_last_of(".") + 1);
+    if (extension == "gz") {
+        return ImageFormat_GZIP;
+    } else if (extension == "zst") {
+        return ImageFormat_ZSTD;
+    }
+    return ImageFormat_RAW;
+}
+
+BlockStream::BlockStream(shared_ptr<BlockWriter> writer, ImageFormat format)
+    : m_format(format)
+    , m_isStreamEnd(false)
+    , m_isFailed(false)
+    , m_zstdStream(nullptr)
+    , m_writer(writer)
+    , m_isDetected(false)
+{
+    setClassName("BlockStream");
+    memset(&m_zstream, 0, sizeof(m_zstream));
+}
+
+BlockStream::~BlockStream()
+{
+    close();
+}
+
+bool BlockStream::open()
+{
+    LOG_DEBUG(getClassName(), __FUNCTION__);
+
+    if (!m_writer) {
+        return false;
+    }
+    // 16 + MAX_WBITS : gzip header
+    if (m_format == ImageFormat_GZIP && inflateInit2(&m_zstream, 16 + MAX_WBITS) != Z_OK) {
+        Logger::error(getClassName(), __FUNCTION__, "Failed to initialize zlib");
+        close();
+        return false;
+    }
+    if (m_format == ImageFormat_ZSTD) {
+        m_zstdStream = ZSTD_createDStream();
+        if (m_zstdStream == nullptr || ZSTD_isError(ZSTD_initDStream(m_zstdStream))) {
+            Logger::error(getClassName(), __FUNCTION__, "Failed to initialize zstd");
+            close();
+            return false;
+        }
+    }
+    m_buffer.resize(BUFFER_SIZE);
+    return true;
+}
+
+bool BlockStream::write(const char* data, size_t size)
+{
+    if (!m_writer || m_isFailed)
+        return false;
+
+    switch (m_format) {
+    case ImageFormat_GZIP:
+        m_isFailed = !inflate(data, size);
+        break;
+    case ImageFormat_ZSTD:
+        m_isFailed = !decompressZstd(data, size);
+        break;
+    default:
+        m_isFailed = !output(data, size);
+        break;
+    }
+    return !m_isFailed;
+}
+
+bool BlockStream::finish(DeployResult& result)
+{
+    LOG_DEBUG(getClassName(), __FUNCTION__);
+
+    bool isFinished = false;
+    if (!m_writer || m_isFailed)
+        goto Done;
+    if (m_format != ImageFormat_RAW && !m_isStreamEnd) {
+        Logger::error(getClassName(), __FUNCTION__, "Unexpected end of compressed stream");
+        goto Done;
+    }
+    // image smaller than the magic
+    if (!m_isDetected && !m_writer->write(m_head.data(), m_head.size()))
+        goto Done;
+    if (m_sparse && !m_sparse->finish())
+        goto Done;
+    isFinished = m_writer->finish();
+
+Done:
+    result.error = getError();
+    if (m_writer) {
+        result.writtenBlocks = m_writer->getWrittenBlocks();
+        result.skippedBlocks = m_writer->getSkippedBlocks();
+    }
+    return isFinished;
+}
+
+bool BlockStream::inflate(const char* data, size_t size)
+{
+    m_zstream.next_in = (Bytef*) data;
+    m_zstream.avail_in = size;
+
+    // zlib can keep output even if all input is consumed. Continue while the output is full.
+    do {
+        // gzip file can have several members. (same as gunzip)
+        if (m_isStreamEnd) {
+            if (m_zstream.avail_in == 0)
+                break;
+            inflateReset(&m_zstream);
+            m_isStreamEnd = false;
+        }
+        m_zstream.next_out = (Bytef*) m_buffer.data();
+        m_zstream.avail_out = m_buffer.size();
+
+        int rc = ::inflate(&m_zstream, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+            m_isStreamEnd = true;
+        } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            Logger::error(getClassName(), __FUNCTION__, "Failed to inflate : " + to_string(rc));
+            return false;
+        }
+        if (!output(m_buffer.data(), m_buffer.size() - m_zstream.avail_out))
+            return false;
+    } while (m_zstream.avail_in > 0 || m_zstream.avail_out == 0);
+    return true;
+}
+
+bool BlockStream::decompressZstd(const char* data, size_t size)
+{
+    ZSTD_inBuffer input = { data, size, 0 };
+    bool isFull = false;
+
+    // same as inflate. flush the output kept in zstd.
+    while (input.pos < input.size || isFull) {
+        ZSTD_outBuffer out = { m_buffer.data(), m_buffer.size(), 0 };
+        size_t rc = ZSTD_decompressStream(m_zstdStream, &out, &input);
+        if (ZSTD_isError(rc)) {
+            Logger::error(getClassName(), __FUNCTION__, string("Failed to decompress : ") + ZSTD_getErrorName(rc));
+            return false;
+        }
+        // 0 : a frame is completely decoded and flushed
+        m_isStreamEnd = (rc == 0);
+        if (!output(m_buffer.data(), out.pos))
+            return false;
+        isFull = (out.pos == out.size);
+    }
+    return true;
+}
+
+bool BlockStream::output(const char* data, size_t size)
+{
+    if (!m_isDetected) {
+        size_t length = min(size, SparseParser::MAGIC_SIZE - m_head.size());
+        m_head.append(data, length);
+        data += length;
+        size -= length;
+        if (m_head.size() < SparseParser::MAGIC_SIZE)
+            return true;
+
+        m_isDetected = true;
+        if (SparseParser::isSparse(m_head.data(), m_head.size())) {
+            Logger::info(getClassName(), __FUNCTION__, "Android sparse image");
+            m_sparse = make_shared<SparseParser>(m_writer);
+        }
+        if (!output(m_head.data(), m_head.size()))
+            return false;
+    }
+
+    if (m_sparse)
+        return m_sparse->write(data, size);
+    return m_writer->write(data, size);
+}
+
+void BlockStream::close()
+{
+    if (m_format == ImageFormat_GZIP && m_zstream.state != NULL) {
+        inflateEnd(&m_zstream);
+    }
+    if (m_zstdStream) {
+        ZSTD_freeDStream(m_zstdStream);
+        m_zstdStream = nullptr;
+    }
+    m_writer = nullptr;
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef UPDATER_BLOCK_BLOCKSTREAM_H_
+#define UPDATER_BLOCK_BLOCKSTREAM_H_
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "updater/AbsUpdater.h"
+#include "updater/block/BlockWriter.h"
+#include "updater/block/SparseParser.h"
+
+using namespace std;
+
+enum ImageFormat {
+    ImageFormat_RAW,
+    ImageFormat_GZIP,
+    ImageFormat_ZSTD,
+};
+
+// Decompresses (optional) and writes an image into the partition while it is downloaded.
+// Android sparse image is detected after decompression, and only its data chunks are written.
+class BlockStream : public AbsUpdateStream {
+public:
+    static ImageFormat toImageFormat(const string& filename);
+
+    // 'writer' should be opened already
+    BlockStream(shared_ptr<BlockWriter> writer, ImageFormat format);
+    virtual ~BlockStream();
+
+    bool open();
+
+    // AbsUpdateStream
+    virtual bool write(const char* data, size_t size) override;
+    virtual bool finish(DeployResult& result) override;
+
+    // errno of the writer. 0 if it failed in decompression.
+    int getError()
+    {
+        return m_writer ? m_writer->getError() : 0;
+    }
+
+    // bytes written to the partition so far. It can be called while writing.
+    uint64_t getWrittenSize()
+    {
+        return m_writer ? m_writer->getWrittenSize() : 0;
+    }
+
+    // bytes of the image if it is known from its header (sparse image). Otherwise 0.
+    uint64_t getImageSize()
+    {
+        return m_sparse ? m_sparse->getImageSize() : 0;
+    }
+
+private:
+    static const size_t BUFFER_SIZE = 1024 * 1024;
+
+    bool inflate(const char* data, size_t size);
+    bool decompressZstd(const char* data, size_t size);
+    bool output(const char* data, size_t size);
+    void close();
+
+    ImageFormat m_format;
+    bool m_isStreamEnd;
+    bool m_isFailed;
+    z_stream m_zstream;
+    ZSTD_DStream* m_zstdStream;
+    vector<char> m_buffer;
+    shared_ptr<BlockWriter> m_writer;
+    // first bytes of the image until its type is known
+    string m_head;
+    bool m_isDetected;
+    shared_ptr<SparseParser> m_sparse;
+};
+
+#endif /* UPDATER_BLOCK_BLOCKSTREAM_H_ */
@@ -18,8 +18,14 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <vector>
 
+#include "Setting.h"
 #include "bootloader/AbsBootloader.h"
+#include "updater/block/BlockStream.h"
+#include "updater/block/VCDiffDecoder.h"
+#include "updater/block/ZstdDecoder.h"
 #include "util/Logger.h"
 
 BlockUpdater::BlockUpdater()
@@ -41,12 +47,158 @@ bool BlockUpdater::onFinalization()
     return true;
 }
 
-bool BlockUpdater::deploy(const string& path, PartitionLabel partitionLabel)
+bool BlockUpdater::deploy(const string& path, PartitionLabel partitionLabel, const DeployOptions& options, DeployResult& result)
 {
-    Logger::debug(getClassName(), __FUNCTION__, path);
+    LOG_DEBUG(getClassName(), __FUNCTION__, path);
 
     bool isDelta = path.rfind(".xd3") != string::npos;
-    bool isGZipped = path.rfind(".gz") != string::npos;
+    string currentPartition;
+    string nextPartition;
+    if (!getPartitions(partitionLabel, currentPartition, nextPartition)) {
+        return false;
+    }
+
+    if (isDelta) {
+        shared_ptr<BlockWriter> writer = openWriter(nextPartition, options, result);
+        if (!writer)
+            return false;
+        VCDiffDecoder decoder;
+        decoder.setSourceWindow(Setting::getInstance().getDeltaSourceWindow());
+        decoder.setProgressCallback(options.progressCallback);
+        bool isDecoded = decoder.decode(currentPartition, path, *writer) && writer->finish();
+        result.error = writer->getError();
+        result.writtenBlocks = writer->getWrittenBlocks();
+        result.skippedBlocks = writer->getSkippedBlocks();
+        return isDecoded;
+    }
+
+    if (BlockStream::toImageFormat(path) == ImageFormat_ZSTD) {
+        return writeZstdImage(path, nextPartition, options, result);
+    }
+    return writeImage(path, nextPartition, options, result);
+}
+
+bool BlockUpdater::writeImage(const string& path, const string& partition, const DeployOptions& options, DeployResult& result)
+{
+    // decompression on this thread, writing on the BlockWriter thread
+    ImageFormat format = BlockStream::toImageFormat(path);
+    BlockStream stream(openWriter(partition, options, result), format);
+    vector<char> buffer(READ_SIZE);
+    uint64_t total = 0;
+    bool isFinished = false;
+    struct stat st;
+
+    FILE* file = fopen(path.c_str(), "rbe");
+    if (file == nullptr || fstat(fileno(file), &st) != 0) {
+        Logger::error(getClassName(), __FUNCTION__, "Failed to open " + path + " : " + strerror(errno));
+        goto Done;
+    }
+    total = (format == ImageFormat_GZIP) ? getGzipSize(file, st.st_size) : st.st_size;
+    if (!stream.open())
+        goto Done;
+
+    while (true) {
+        size_t length = fread(buffer.data(), 1, buffer.size(), file);
+        if (length == 0)
+            break;
+        if (!stream.write(buffer.data(), length)) {
+            Logger::error(getClassName(), __FUNCTION__, "Failed to write image : " + string(strerror(stream.getError())));
+            goto Done;
+        }
+        if (options.progressCallback) {
+            // Progress is what is in the partition, not what is read. The writer is behind the reader.
+            uint64_t written = stream.getWrittenSize();
+            if (stream.getImageSize() > 0) {
+                total = stream.getImageSize();
+            } else {
+                // gzip keeps the size modulo 4GB
+                while (format == ImageFormat_GZIP && written > total)
+                    total += 1ULL << 32;
+            }
+            options.progressCallback(min(written, total), total);
+        }
+    }
+    if (ferror(file)) {
+        Logger::error(getClassName(), __FUNCTION__, "Failed to read " + path + " : " + strerror(errno));
+        goto Done;
+    }
+    isFinished = stream.finish(result);
+
+Done:
+    if (file)
+        fclose(file);
+    if (stream.getError() != 0)
+        result.error = stream.getError();
+    return isFinished;
+}
+
+bool BlockUpdater::writeZstdImage(const string& path, const string& partition, const DeployOptions& options, DeployResult& result)
+{
+    // Whole file is available. Independent frames are decompressed in parallel.
+    // Decompressed data goes through BlockStream, because it can be a sparse image.
+    BlockStream stream(openWriter(partition, options, result), ImageFormat_RAW);
+    if (!stream.open())
+        return false;
+
+    ZstdDecoder decoder;
+    decoder.setProgressCallback(options.progressCallback);
+    if (!decoder.decode(path, stream)) {
+        result.error = stream.getError();
+        if (result.error != 0)
+            Logger::error(getClassName(), __FUNCTION__, "Failed to write image : " + string(strerror(result.error)));
+        return false;
+    }
+    return stream.finish(result);
+}
+
+uint64_t BlockUpdater::getGzipSize(FILE* file, uint64_t fileSize)
+{
+    // ISIZE : last 4 bytes of gzip, uncompressed size modulo 2^32 (little endian)
+    uint8_t trailer[4];
+    uint64_t size = fileSize;
+    if (fileSize >= sizeof(trailer) && fseeko(file, -(off_t) sizeof(trailer), SEEK_END) == 0 &&
+        fread(trailer, 1, sizeof(trailer), file) == sizeof(trailer)) {
+        size = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint64_t) trailer[3] << 24);
+    }
+    rewind(file);
+    return size;
+}
+
+shared_ptr<BlockWriter> BlockUpdater::openWriter(const string& partition, const DeployOptions& options, DeployResult& result)
+{
+    shared_ptr<BlockWriter> writer = make_shared<BlockWriter>(partition);
+    writer->setCompareMode(options.isCompareWrite);
+    if (!writer->open()) {
+        result.error = writer->getError();
+        return nullptr;
+    }
+    return writer;
+}
+
+shared_ptr<AbsUpdateStream> BlockUpdater::openStream(const string& filename, PartitionLabel partitionLabel, const DeployOptions& options)
+{
+    LOG_DEBUG(getClassName(), __FUNCTION__, filename);
+
+    // delta needs whole file
+    if (filename.rfind(".xd3") != string::npos) {
+        return nullptr;
+    }
+    string currentPartition;
+    string nextPartition;
+    if (!getPartitions(partitionLabel, currentPartition, nextPartition)) {
+        return nullptr;
+    }
+
+    DeployResult result;
+    shared_ptr<BlockStream> stream = make_shared<BlockStream>(openWriter(nextPartition, options, result), BlockStream::toImageFormat(filename));
+    if (!stream->open()) {
+        return nullptr;
+    }
+    return stream;
+}
+
+bool BlockUpdater::getPartitions(PartitionLabel partitionLabel, string& currentPartition, string& nextPartition)
+{
     int bootSlot = AbsBootloader::getBootloader().getBootSlot();
     string bootSlotStr = (bootSlot == 0) ? "a" : "b";
     string nextSlotStr = (bootSlot == 0) ? "b" : "a";
@@ -64,33 +216,24 @@ bool BlockUpdater::deploy(const string& path, PartitionLabel partitionLabel)
         Logger::error(getClassName(), __FUNCTION__, "Unknown partition: " + to_string(partitionLabel));
         return false;
     }
-    Logger::debug(getClassName(), __FUNCTION__, partitionPrefix + bootSlotStr + " to " + nextSlotStr);
+    LOG_DEBUG(getClassName(), __FUNCTION__, partitionPrefix + bootSlotStr + " to " + nextSlotStr);
 
-    char currentPartition[PATH_MAX] = { 0, };
-    char nextPartition[PATH_MAX] = { 0, };
-    if (realpath((partitionPrefix + bootSlotStr).c_str(), currentPartition) == NULL ||
-        realpath((partitionPrefix + nextSlotStr).c_str(), nextPartition) == NULL) {
+    char current[PATH_MAX] = { 0, };
+    char next[PATH_MAX] = { 0, };
+    if (realpath((partitionPrefix + bootSlotStr).c_str(), current) == NULL ||
+        realpath((partitionPrefix + nextSlotStr).c_str(), next) == NULL) {
         Logger::error(getClassName(), __FUNCTION__, string("Get realpath error: ") + strerror(errno));
         return false;
     }
-    Logger::debug(getClassName(), __FUNCTION__, string(currentPartition) + " to " + nextPartition);
-
-    string systemCmd;
-    if (isDelta) {
-        systemCmd = "xdelta3 -S none -d -s " + string(currentPartition) + " " + path + " " + nextPartition;
-    } else if (isGZipped) {
-        systemCmd = "gunzip -c " + path + " | dd iflag=fullblock oflag=direct status=progress bs=4M of=" + nextPartition + "; sync";
-    } else {
-        systemCmd = "dd if=" + path + " oflag=direct status=progress bs=4M of=" + nextPartition + "; sync";
-    }
-    Logger::debug(getClassName(), __FUNCTION__, systemCmd);
-    int rc = system(systemCmd.c_str());
-    return WIFEXITED(rc) && WEXITSTATUS(rc) == 0;
+    LOG_DEBUG(getClassName(), __FUNCTION__, string(current) + " to " + next);
+    currentPartition = current;
+    nextPartition = next;
+    return true;
 }
 
 bool BlockUpdater::undeploy()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     int bootSlot = AbsBootloader::getBootloader().getBootSlot();
     if (AbsBootloader::getBootloader().setActive(bootSlot)) {
@@ -98,25 +241,25 @@ bool BlockUpdater::undeploy()
         return false;
     }
 
-    Logger::debug(getClassName(), __FUNCTION__, to_string(bootSlot));
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(bootSlot));
     return true;
 }
 
 bool BlockUpdater::setReadWriteMode()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     return true;
 }
 
 bool BlockUpdater::isUpdated()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 
     return true;
 }
 
 void BlockUpdater::printDebug()
 {
-    Logger::debug(getClassName(), __FUNCTION__);
+    LOG_DEBUG(getClassName(), __FUNCTION__);
 }
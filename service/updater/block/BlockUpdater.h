@@ -18,8 +18,11 @@
 #define UPDATER_BLOCK_BLOCKUPDATER_H_
 
 #include <iostream>
+#include <stdint.h>
+#include <stdio.h>
 
 #include "updater/AbsUpdater.h"
+#include "updater/block/BlockWriter.h"
 
 using namespace std;
 
@@ -31,7 +34,8 @@ public:
     virtual bool onInitialization() override;
     virtual bool onFinalization() override;
 
-    virtual bool deploy(const string& path, PartitionLabel partitionLabel) override;
+    virtual bool deploy(const string& path, PartitionLabel partitionLabel, const DeployOptions& options, DeployResult& result) override;
+    virtual shared_ptr<AbsUpdateStream> openStream(const string& filename, PartitionLabel partitionLabel, const DeployOptions& options) override;
     virtual bool undeploy() override;
     virtual bool setReadWriteMode() override;
     virtual bool isUpdated() override;
@@ -39,6 +43,16 @@ public:
 
 private:
     BlockUpdater();
+
+    static const size_t READ_SIZE = 1024 * 1024;
+
+    // uncompressed size in the gzip trailer. It is modulo 4GB.
+    static uint64_t getGzipSize(FILE* file, uint64_t fileSize);
+
+    bool writeImage(const string& path, const string& partition, const DeployOptions& options, DeployResult& result);
+    bool writeZstdImage(const string& path, const string& partition, const DeployOptions& options, DeployResult& result);
+    shared_ptr<BlockWriter> openWriter(const string& partition, const DeployOptions& options, DeployResult& result);
+    bool getPartitions(PartitionLabel partitionLabel, string& currentPartition, string& nextPartition);
 };
 
 #endif /* UPDATER_BLOCK_BLOCKUPDATER_H_ */
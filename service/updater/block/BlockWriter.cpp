@@ -0,0 +1,325 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "updater/block/BlockWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "util/Logger.h"
+
+const size_t BlockWriter::COMPARE_BLOCK_SIZE;
+
+BlockWriter::BlockWriter(const string& device)
+    : m_device(device)
+    , m_fd(-1)
+    , m_isDirect(false)
+    , m_isCompareMode(false)
+    , m_offset(0)
+    , m_readBuffer(nullptr)
+    , m_zeroBuffer(nullptr)
+    , m_current(nullptr)
+    , m_isStopping(false)
+    , m_error(0)
+    , m_written(0)
+    , m_writtenBlocks(0)
+    , m_skippedBlocks(0)
+{
+    setClassName("BlockWriter");
+}
+
+BlockWriter::~BlockWriter()
+{
+    stop();
+    for (Buffer& buffer : m_buffers) {
+        free(buffer.data);
+    }
+    free(m_readBuffer);
+    free(m_zeroBuffer);
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool BlockWriter::open()
+{
+    // Some filesystems (i.e. tmpfs) don't support O_DIRECT
+    int mode = m_isCompareMode ? O_RDWR : O_WRONLY;
+    m_fd = ::open(m_device.c_str(), mode | O_CLOEXEC | O_DIRECT);
+    m_isDirect = (m_fd >= 0);
+    if (m_fd < 0 && errno == EINVAL) {
+        m_fd = ::open(m_device.c_str(), mode | O_CLOEXEC);
+    }
+    if (m_fd < 0) {
+        m_error = errno;
+        Logger::error(getClassName(), __FUNCTION__, "Failed to open " + m_device + " : " + strerror(errno));
+        return false;
+    }
+
+    m_buffers.resize(BUFFER_COUNT);
+    for (Buffer& buffer : m_buffers) {
+        void* data = nullptr;
+        if (posix_memalign(&data, ALIGNMENT, BUFFER_SIZE) != 0) {
+            m_error = ENOMEM;
+            Logger::error(getClassName(), __FUNCTION__, "Failed to allocate buffer");
+            return false;
+        }
+        buffer.data = (uint8_t*) data;
+        buffer.length = 0;
+        buffer.holeLength = 0;
+        buffer.isZeroHole = false;
+        m_freeBuffers.push_back(&buffer);
+    }
+    m_current = m_freeBuffers.front();
+    m_freeBuffers.pop_front();
+
+    if (m_isCompareMode) {
+        void* data = nullptr;
+        if (posix_memalign(&data, ALIGNMENT, COMPARE_BLOCK_SIZE) != 0) {
+            m_error = ENOMEM;
+            Logger::error(getClassName(), __FUNCTION__, "Failed to allocate buffer");
+            return false;
+        }
+        m_readBuffer = (uint8_t*) data;
+    }
+
+    m_thread = thread(&BlockWriter::run, this);
+    return true;
+}
+
+bool BlockWriter::write(const void* data, size_t size)
+{
+    const uint8_t* ptr = (const uint8_t*) data;
+
+    while (size > 0) {
+        if (m_error != 0 || m_current == nullptr)
+            return false;
+
+        size_t length = min(size, BUFFER_SIZE - m_current->length);
+        memcpy(m_current->data + m_current->length, ptr, length);
+        m_current->length += length;
+        ptr += length;
+        size -= length;
+
+        if (m_current->length == BUFFER_SIZE && !submit())
+            return false;
+    }
+    return true;
+}
+
+bool BlockWriter::writeZeroes(uint64_t length)
+{
+    return addHole(length, true);
+}
+
+bool BlockWriter::discard(uint64_t length)
+{
+    return addHole(length, false);
+}
+
+bool BlockWriter::addHole(uint64_t length, bool isZero)
+{
+    if (m_error != 0 || m_current == nullptr)
+        return false;
+    if (length == 0)
+        return true;
+
+    // The hole follows the data in the current buffer
+    m_current->holeLength = length;
+    m_current->isZeroHole = isZero;
+    return submit();
+}
+
+bool BlockWriter::finish()
+{
+    if (m_current == nullptr)
+        return false;
+
+    if (m_current->length > 0 || m_current->holeLength > 0) {
+        unique_lock<mutex> lock(m_mutex);
+        m_filledBuffers.push_back(m_current);
+    }
+    m_current = nullptr;
+    stop();
+
+    if (m_error != 0)
+        return false;
+    // only this partition. (not global 'sync')
+    if (fsync(m_fd) != 0) {
+        m_error = errno;
+        Logger::error(getClassName(), __FUNCTION__, "Failed to sync " + m_device + " : " + strerror(errno));
+        return false;
+    }
+    Logger::info(getClassName(), __FUNCTION__, to_string(m_written) + " bytes are written to " + m_device);
+    if (m_isCompareMode) {
+        Logger::info(getClassName(), __FUNCTION__, "Blocks written : " + to_string(m_writtenBlocks) + " / skipped : " + to_string(m_skippedBlocks));
+    }
+    return true;
+}
+
+bool BlockWriter::submit()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_filledBuffers.push_back(m_current);
+    m_current = nullptr;
+    m_condition.notify_all();
+
+    // Wait until the writer thread returns a buffer
+    m_condition.wait(lock, [this] { return !m_freeBuffers.empty() || m_error != 0; });
+    if (m_error != 0)
+        return false;
+    m_current = m_freeBuffers.front();
+    m_freeBuffers.pop_front();
+    return true;
+}
+
+void BlockWriter::run()
+{
+    unique_lock<mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this] { return !m_filledBuffers.empty() || m_isStopping; });
+        if (m_filledBuffers.empty())
+            break;
+
+        Buffer* buffer = m_filledBuffers.front();
+        m_filledBuffers.pop_front();
+        lock.unlock();
+        bool result = (m_error == 0) && writeBuffer(buffer);
+        lock.lock();
+
+        buffer->length = 0;
+        buffer->holeLength = 0;
+        m_freeBuffers.push_back(buffer);
+        m_condition.notify_all();
+        if (!result)
+            break;
+    }
+}
+
+bool BlockWriter::writeBuffer(Buffer* buffer)
+{
+    // BUFFER_SIZE is multiple of COMPARE_BLOCK_SIZE
+    for (size_t offset = 0; offset < buffer->length; offset += COMPARE_BLOCK_SIZE) {
+        size_t length = min(COMPARE_BLOCK_SIZE, buffer->length - offset);
+        if (m_isCompareMode && isSameBlock(buffer->data + offset, length)) {
+            m_skippedBlocks++;
+        } else {
+            if (!writeBlock(buffer->data + offset, length))
+                return false;
+            m_writtenBlocks++;
+        }
+        m_offset += length;
+        m_written += length;
+    }
+    if (buffer->holeLength > 0)
+        return writeHole(buffer->holeLength, buffer->isZeroHole);
+    return true;
+}
+
+bool BlockWriter::writeHole(uint64_t length, bool isZero)
+{
+    uint64_t range[2] = { m_offset, length };
+
+    if (!isZero) {
+        // Failure doesn't matter. (i.e. regular file or no discard support)
+        ioctl(m_fd, BLKDISCARD, range);
+    } else if (ioctl(m_fd, BLKZEROOUT, range) != 0) {
+        // Not a block device or not aligned. Write zeroes.
+        if (m_zeroBuffer == nullptr) {
+            void* data = nullptr;
+            if (posix_memalign(&data, ALIGNMENT, COMPARE_BLOCK_SIZE) != 0) {
+                m_error = ENOMEM;
+                return false;
+            }
+            memset(data, 0, COMPARE_BLOCK_SIZE);
+            m_zeroBuffer = (uint8_t*) data;
+        }
+        for (uint64_t offset = 0; offset < length; offset += COMPARE_BLOCK_SIZE) {
+            size_t size = min((uint64_t) COMPARE_BLOCK_SIZE, length - offset);
+            if (!writeBlock(m_zeroBuffer, size))
+                return false;
+            m_offset += size;
+            m_written += size;
+        }
+        return true;
+    }
+    m_offset += length;
+    m_written += length;
+    return true;
+}
+
+bool BlockWriter::writeBlock(const uint8_t* data, size_t length)
+{
+    // O_DIRECT needs aligned offset and length. A partial block (i.e. the tail of the image, or data before a hole)
+    // is written through page cache, and O_DIRECT is set again for the following blocks.
+    bool isBuffered = m_isDirect && ((m_offset | length) % ALIGNMENT != 0);
+    int flags = 0;
+    bool result = true;
+    if (isBuffered) {
+        flags = fcntl(m_fd, F_GETFL);
+        fcntl(m_fd, F_SETFL, flags & ~O_DIRECT);
+    }
+
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t rc = pwrite(m_fd, data + offset, length - offset, m_offset + offset);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0) {
+            m_error = errno;
+            Logger::error(getClassName(), __FUNCTION__, "Failed to write " + m_device + " : " + strerror(errno));
+            result = false;
+            break;
+        }
+        offset += rc;
+    }
+
+    if (isBuffered)
+        fcntl(m_fd, F_SETFL, flags);
+    return result;
+}
+
+bool BlockWriter::isSameBlock(const uint8_t* data, size_t length)
+{
+    // Reading is much cheaper than writing on eMMC. Any read failure means 'different'.
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t rc = pread(m_fd, m_readBuffer + offset, length - offset, m_offset + offset);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+        offset += rc;
+    }
+    return memcmp(m_readBuffer, data, length) == 0;
+}
+
+void BlockWriter::stop()
+{
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_isStopping = true;
+        m_condition.notify_all();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
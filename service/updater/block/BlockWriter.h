@@ -0,0 +1,127 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef UPDATER_BLOCK_BLOCKWRITER_H_
+#define UPDATER_BLOCK_BLOCKWRITER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "interface/IClassName.h"
+
+using namespace std;
+
+// Writes data sequentially to a partition with O_DIRECT.
+// Data is gathered into aligned buffers on the caller's thread and written on a writer thread.
+class BlockWriter : public IClassName {
+public:
+    BlockWriter(const string& device);
+    virtual ~BlockWriter();
+
+    // Read the partition first and write only the blocks which are different.
+    // It should be set before 'open'.
+    void setCompareMode(bool isCompareMode)
+    {
+        m_isCompareMode = isCompareMode;
+    }
+
+    bool open();
+    bool write(const void* data, size_t size);
+    // Holes after the data written so far. Zero range is filled with zeroes (BLKZEROOUT).
+    // Discarded range is 'don't care' and can be anything after it (BLKDISCARD).
+    bool writeZeroes(uint64_t length);
+    bool discard(uint64_t length);
+    // Write the remaining data and fsync. Nothing is written after this.
+    bool finish();
+
+    // errno of the first failure
+    int getError()
+    {
+        return m_error;
+    }
+
+    // bytes written to the partition (including skipped blocks)
+    uint64_t getWrittenSize()
+    {
+        return m_written;
+    }
+
+    // blocks which are written / skipped in compare mode
+    uint64_t getWrittenBlocks()
+    {
+        return m_writtenBlocks;
+    }
+
+    uint64_t getSkippedBlocks()
+    {
+        return m_skippedBlocks;
+    }
+
+private:
+    static const size_t BUFFER_SIZE = 4 * 1024 * 1024;
+    static const size_t BUFFER_COUNT = 3;
+    static const size_t ALIGNMENT = 4096;
+    static const size_t COMPARE_BLOCK_SIZE = 1024 * 1024;
+
+    struct Buffer {
+        uint8_t* data;
+        size_t length;
+        // hole after data
+        uint64_t holeLength;
+        bool isZeroHole;
+    };
+
+    void run();
+    bool submit();
+    bool addHole(uint64_t length, bool isZero);
+    bool writeBuffer(Buffer* buffer);
+    bool writeHole(uint64_t length, bool isZero);
+    bool writeBlock(const uint8_t* data, size_t length);
+    bool isSameBlock(const uint8_t* data, size_t length);
+    void stop();
+
+    string m_device;
+    int m_fd;
+    // O_DIRECT is available
+    bool m_isDirect;
+    bool m_isCompareMode;
+    uint64_t m_offset;
+    uint8_t* m_readBuffer;
+    uint8_t* m_zeroBuffer;
+
+    vector<Buffer> m_buffers;
+    deque<Buffer*> m_freeBuffers;
+    deque<Buffer*> m_filledBuffers;
+    Buffer* m_current;
+
+    thread m_thread;
+    mutex m_mutex;
+    condition_variable m_condition;
+    bool m_isStopping;
+
+    atomic<int> m_error;
+    atomic<uint64_t> m_written;
+    atomic<uint64_t> m_writtenBlocks;
+    atomic<uint64_t> m_skippedBlocks;
+};
+
+#endif /* UPDATER_BLOCK_BLOCKWRITER_H_ */
@@ -0,0 +1,238 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "updater/block/SparseParser.h"
+
+#include <string.h>
+#include <vector>
+
+#include "util/Logger.h"
+
+// system/core/libsparse/sparse_format.h
+#define SPARSE_HEADER_MAGIC     0xED26FF3A
+#define CHUNK_TYPE_RAW          0xCAC1
+#define CHUNK_TYPE_FILL         0xCAC2
+#define CHUNK_TYPE_DONT_CARE    0xCAC3
+#define CHUNK_TYPE_CRC32        0xCAC4
+
+static uint16_t readLE16(const char* p)
+{
+    return (uint8_t) p[0] | ((uint8_t) p[1] << 8);
+}
+
+static uint32_t readLE32(const char* p)
+{
+    return (uint32_t) readLE16(p) | ((uint32_t) readLE16(p + 2) << 16);
+}
+
+bool SparseParser::isSparse(const void* data, size_t size)
+{
+    return size >= MAGIC_SIZE && readLE32((const char*) data) == SPARSE_HEADER_MAGIC;
+}
+
+SparseParser::SparseParser(shared_ptr<BlockWriter> writer)
+    : m_writer(writer)
+    , m_state(State_FILE_HEADER)
+    , m_headerSize(FILE_HEADER_SIZE)
+    , m_blockSize(0)
+    , m_totalBlocks(0)
+    , m_totalChunks(0)
+    , m_chunkHeaderSize(CHUNK_HEADER_SIZE)
+    , m_chunks(0)
+    , m_blocks(0)
+    , m_remained(0)
+    , m_fillLength(0)
+{
+    setClassName("SparseParser");
+}
+
+SparseParser::~SparseParser()
+{
+}
+
+bool SparseParser::write(const char* data, size_t size)
+{
+    while (size > 0) {
+        switch (m_state) {
+        case State_FILE_HEADER:
+        case State_CHUNK_HEADER:
+        case State_FILL: {
+            size_t length = min(size, m_headerSize - m_header.size());
+            m_header.append(data, length);
+            data += length;
+            size -= length;
+            if (m_header.size() < m_headerSize)
+                break;
+
+            bool result = false;
+            if (m_state == State_FILE_HEADER)
+                result = parseFileHeader();
+            else if (m_state == State_CHUNK_HEADER)
+                result = parseChunkHeader();
+            else
+                result = writeFill();
+            if (!result)
+                return false;
+            break;
+        }
+
+        case State_RAW:
+        case State_SKIP: {
+            size_t length = (size_t) min((uint64_t) size, m_remained);
+            if (m_state == State_RAW && !m_writer->write(data, length))
+                return false;
+            data += length;
+            size -= length;
+            m_remained -= length;
+            break;
+        }
+
+        case State_DONE:
+            // Trailing data after the last chunk is ignored
+            return true;
+        }
+
+        if ((m_state == State_RAW || m_state == State_SKIP) && m_remained == 0) {
+            m_state = (m_chunks == m_totalChunks) ? State_DONE : State_CHUNK_HEADER;
+            m_header.clear();
+            m_headerSize = m_chunkHeaderSize;
+        }
+    }
+    return true;
+}
+
+bool SparseParser::finish()
+{
+    if (m_state != State_DONE || m_blocks != m_totalBlocks) {
+        Logger::error(getClassName(), __FUNCTION__, "Incomplete sparse image : " + to_string(m_blocks) + "/" + to_string(m_totalBlocks) + " blocks");
+        return false;
+    }
+    return true;
+}
+
+bool SparseParser::parseFileHeader()
+{
+    const char* p = m_header.data();
+    uint16_t majorVersion = readLE16(p + 4);
+    uint16_t fileHeaderSize = readLE16(p + 8);
+    m_chunkHeaderSize = readLE16(p + 10);
+    m_blockSize = readLE32(p + 12);
+    m_totalBlocks = readLE32(p + 16);
+    m_totalChunks = readLE32(p + 20);
+
+    if (majorVersion != 1 || fileHeaderSize < FILE_HEADER_SIZE || m_chunkHeaderSize < CHUNK_HEADER_SIZE ||
+        m_blockSize == 0 || m_blockSize % 4 != 0) {
+        Logger::error(getClassName(), __FUNCTION__, "Invalid sparse header");
+        return false;
+    }
+    Logger::info(getClassName(), __FUNCTION__, to_string(m_totalBlocks) + " blocks / " + to_string(m_totalChunks) + " chunks");
+
+    m_header.clear();
+    m_headerSize = m_chunkHeaderSize;
+    m_state = State_CHUNK_HEADER;
+    // bigger header than known
+    if (fileHeaderSize > FILE_HEADER_SIZE) {
+        m_remained = fileHeaderSize - FILE_HEADER_SIZE;
+        m_state = State_SKIP;
+    } else if (m_totalChunks == 0) {
+        m_state = State_DONE;
+    }
+    return true;
+}
+
+bool SparseParser::parseChunkHeader()
+{
+    const char* p = m_header.data();
+    uint16_t type = readLE16(p);
+    uint32_t chunkBlocks = readLE32(p + 4);
+    uint32_t totalSize = readLE32(p + 8);
+    uint64_t length = (uint64_t) chunkBlocks * m_blockSize;
+    uint64_t dataSize = totalSize - m_chunkHeaderSize;
+
+    if (totalSize < m_chunkHeaderSize || m_blocks + chunkBlocks > m_totalBlocks) {
+        Logger::error(getClassName(), __FUNCTION__, "Invalid chunk : " + to_string(m_chunks));
+        return false;
+    }
+    m_chunks++;
+    m_blocks += chunkBlocks;
+    m_header.clear();
+
+    switch (type) {
+    case CHUNK_TYPE_RAW:
+        if (dataSize != length)
+            goto Error;
+        m_remained = length;
+        m_state = State_RAW;
+        break;
+
+    case CHUNK_TYPE_FILL:
+        if (dataSize != 4)
+            goto Error;
+        m_fillLength = length;
+        m_headerSize = 4;
+        m_state = State_FILL;
+        return true;
+
+    case CHUNK_TYPE_DONT_CARE:
+        if (dataSize != 0 || !m_writer->discard(length))
+            goto Error;
+        m_remained = 0;
+        m_state = State_SKIP;
+        break;
+
+    case CHUNK_TYPE_CRC32:
+        // CRC of the image isn't checked. The artifact hash covers it.
+        m_remained = dataSize;
+        m_state = State_SKIP;
+        break;
+
+    default:
+        goto Error;
+    }
+
+    if (m_remained == 0) {
+        m_state = (m_chunks == m_totalChunks) ? State_DONE : State_CHUNK_HEADER;
+        m_headerSize = m_chunkHeaderSize;
+    }
+    return true;
+
+Error:
+    Logger::error(getClassName(), __FUNCTION__, "Invalid chunk (type: " + to_string(type) + ")");
+    return false;
+}
+
+bool SparseParser::writeFill()
+{
+    uint32_t value = readLE32(m_header.data());
+    bool result = true;
+
+    if (value == 0) {
+        result = m_writer->writeZeroes(m_fillLength);
+    } else {
+        vector<uint32_t> pattern(min((uint64_t) 1024 * 1024, m_fillLength) / sizeof(uint32_t), value);
+        uint64_t length = m_fillLength;
+        while (result && length > 0) {
+            size_t size = (size_t) min((uint64_t) pattern.size() * sizeof(uint32_t), length);
+            result = m_writer->write(pattern.data(), size);
+            length -= size;
+        }
+    }
+
+    m_header.clear();
+    m_headerSize = m_chunkHeaderSize;
+    m_state = (m_chunks == m_totalChunks) ? State_DONE : State_CHUNK_HEADER;
+    return result;
+}
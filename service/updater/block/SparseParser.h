@@ -0,0 +1,87 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef UPDATER_BLOCK_SPARSEPARSER_H_
+#define UPDATER_BLOCK_SPARSEPARSER_H_
+
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include "interface/IClassName.h"
+#include "updater/block/BlockWriter.h"
+
+using namespace std;
+
+// Writes Android sparse image (simg) while it is received.
+// Only RAW chunks are written. FILL chunks of zero and DONT_CARE chunks become holes.
+class SparseParser : public IClassName {
+public:
+    static const size_t MAGIC_SIZE = 4;
+
+    // 'data' should have at least MAGIC_SIZE bytes
+    static bool isSparse(const void* data, size_t size);
+
+    SparseParser(shared_ptr<BlockWriter> writer);
+    virtual ~SparseParser();
+
+    bool write(const char* data, size_t size);
+    // All chunks should be received
+    bool finish();
+
+    // bytes of the expanded image. 0 until the file header is received.
+    uint64_t getImageSize()
+    {
+        return (uint64_t) m_totalBlocks * m_blockSize;
+    }
+
+private:
+    enum State {
+        State_FILE_HEADER,
+        State_CHUNK_HEADER,
+        State_RAW,
+        State_FILL,
+        State_SKIP,
+        State_DONE,
+    };
+
+    static const size_t FILE_HEADER_SIZE = 28;
+    static const size_t CHUNK_HEADER_SIZE = 12;
+
+    bool parseFileHeader();
+    bool parseChunkHeader();
+    bool writeFill();
+
+    shared_ptr<BlockWriter> m_writer;
+    State m_state;
+    // bytes to be collected for headers and fill value
+    string m_header;
+    size_t m_headerSize;
+
+    uint32_t m_blockSize;
+    uint32_t m_totalBlocks;
+    uint32_t m_totalChunks;
+    uint32_t m_chunkHeaderSize;
+
+    uint32_t m_chunks;
+    uint64_t m_blocks;
+    // bytes remained in the current chunk
+    uint64_t m_remained;
+    uint64_t m_fillLength;
+};
+
+#endif /* UPDATER_BLOCK_SPARSEPARSER_H_ */
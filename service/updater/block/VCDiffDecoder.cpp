@@ -0,0 +1,422 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "updater/block/VCDiffDecoder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "util/Logger.h"
+
+// RFC 3284 4.1 and xdelta3 extensions
+#define VCD_SECONDARY   0x01
+#define VCD_CODETABLE   0x02
+#define VCD_APPHEADER   0x04
+
+// RFC 3284 4.2 and xdelta3 extensions
+#define VCD_SOURCE      0x01
+#define VCD_TARGET      0x02
+#define VCD_ADLER32     0x04
+
+// address modes (RFC 3284 5.3)
+#define VCD_SELF        0
+#define VCD_HERE        1
+
+VCDiffDecoder::Instruction VCDiffDecoder::s_codeTable[256][2];
+
+void VCDiffDecoder::initCodeTable()
+{
+    // default code table (RFC 3284 5.6)
+    static bool isInitialized = false;
+    if (isInitialized)
+        return;
+
+    memset(s_codeTable, 0, sizeof(s_codeTable));
+    int index = 0;
+    s_codeTable[index++][0] = { InstructionType_RUN, 0, 0 };
+    for (uint8_t size = 0; size <= 17; size++) {
+        s_codeTable[index++][0] = { InstructionType_ADD, size, 0 };
+    }
+    for (uint8_t mode = 0; mode <= 8; mode++) {
+        s_codeTable[index++][0] = { InstructionType_COPY, 0, mode };
+        for (uint8_t size = 4; size <= 18; size++) {
+            s_codeTable[index++][0] = { InstructionType_COPY, size, mode };
+        }
+    }
+    for (uint8_t mode = 0; mode <= 5; mode++) {
+        for (uint8_t addSize = 1; addSize <= 4; addSize++) {
+            for (uint8_t copySize = 4; copySize <= 6; copySize++) {
+                s_codeTable[index][0] = { InstructionType_ADD, addSize, 0 };
+                s_codeTable[index++][1] = { InstructionType_COPY, copySize, mode };
+            }
+        }
+    }
+    for (uint8_t mode = 6; mode <= 8; mode++) {
+        for (uint8_t addSize = 1; addSize <= 4; addSize++) {
+            s_codeTable[index][0] = { InstructionType_ADD, addSize, 0 };
+            s_codeTable[index++][1] = { InstructionType_COPY, 4, mode };
+        }
+    }
+    for (uint8_t mode = 0; mode <= 8; mode++) {
+        s_codeTable[index][0] = { InstructionType_COPY, 4, mode };
+        s_codeTable[index++][1] = { InstructionType_ADD, 1, 0 };
+    }
+    isInitialized = true;
+}
+
+bool VCDiffDecoder::Section::readByte(uint8_t& value)
+{
+    if (pos >= end)
+        return false;
+    value = *pos++;
+    return true;
+}
+
+bool VCDiffDecoder::Section::readVarint(uint64_t& value)
+{
+    value = 0;
+    for (int i = 0; i < 10; i++) {
+        uint8_t byte;
+        if (!readByte(byte))
+            return false;
+        value = (value << 7) | (byte & 0x7F);
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+VCDiffDecoder::VCDiffDecoder()
+    : m_sourceWindow(DEFAULT_SOURCE_WINDOW)
+    , m_sourceFd(-1)
+    , m_writer(nullptr)
+    , m_deltaData(nullptr)
+    , m_deltaSize(0)
+    , m_delta({ nullptr, nullptr })
+    , m_nextSlot(0)
+{
+    setClassName("VCDiffDecoder");
+    initCodeTable();
+}
+
+VCDiffDecoder::~VCDiffDecoder()
+{
+    close();
+}
+
+bool VCDiffDecoder::decode(const string& source, const string& delta, BlockWriter& writer)
+{
+    Logger::info(getClassName(), __FUNCTION__, source + " + " + delta);
+
+    bool result = false;
+    uint8_t indicator;
+
+    m_writer = &writer;
+    if (!open(source, delta))
+        goto Done;
+    if (!readHeader())
+        goto Done;
+
+    while (m_delta.readByte(indicator)) {
+        if (!decodeWindow(indicator))
+            goto Done;
+        if (m_progressCallback)
+            m_progressCallback(m_delta.pos - m_deltaData, m_deltaSize);
+    }
+    result = true;
+
+Done:
+    close();
+    return result;
+}
+
+bool VCDiffDecoder::open(const string& source, const string& delta)
+{
+    struct stat st;
+
+    m_sourceFd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_sourceFd < 0) {
+        Logger::error(getClassName(), __FUNCTION__, "Failed to open " + source + " : " + strerror(errno));
+        return false;
+    }
+    // Delta is read byte by byte. It is mapped instead of going through stdio.
+    int fd = ::open(delta.c_str(), O_RDONLY | O_CLOEXEC);
+    void* data = MAP_FAILED;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        Logger::error(getClassName(), __FUNCTION__, "Failed to open " + delta + " : " + strerror(errno));
+    } else {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            Logger::error(getClassName(), __FUNCTION__, "Failed to mmap " + delta + " : " + strerror(errno));
+    }
+    if (fd >= 0)
+        ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    m_deltaData = (const uint8_t*) data;
+    m_deltaSize = st.st_size;
+    m_delta = { m_deltaData, m_deltaData + m_deltaSize };
+    return true;
+}
+
+void VCDiffDecoder::close()
+{
+    if (m_sourceFd >= 0) {
+        ::close(m_sourceFd);
+        m_sourceFd = -1;
+    }
+    if (m_deltaData) {
+        munmap((void*) m_deltaData, m_deltaSize);
+        m_deltaData = nullptr;
+        m_deltaSize = 0;
+        m_delta = { nullptr, nullptr };
+    }
+    m_writer = nullptr;
+    m_blocks.clear();
+    m_blockMap.clear();
+    m_window.clear();
+    m_window.shrink_to_fit();
+}
+
+bool VCDiffDecoder::readHeader()
+{
+    static const uint8_t MAGIC[4] = { 0xD6, 0xC3, 0xC4, 0x00 };
+    uint8_t indicator;
+
+    if (m_delta.end - m_delta.pos < (ptrdiff_t) sizeof(MAGIC) || memcmp(m_delta.pos, MAGIC, sizeof(MAGIC)) != 0) {
+        Logger::error(getClassName(), __FUNCTION__, "Not a VCDIFF file");
+        return false;
+    }
+    m_delta.pos += sizeof(MAGIC);
+    if (!m_delta.readByte(indicator))
+        return false;
+    if (indicator & (VCD_SECONDARY | VCD_CODETABLE)) {
+        Logger::error(getClassName(), __FUNCTION__, "Secondary compression and custom code table are not supported");
+        return false;
+    }
+    if (indicator & VCD_APPHEADER) {
+        uint64_t length;
+        if (!m_delta.readVarint(length) || length > (uint64_t) (m_delta.end - m_delta.pos))
+            return false;
+        m_delta.pos += length;
+    }
+    return true;
+}
+
+bool VCDiffDecoder::decodeWindow(uint8_t indicator)
+{
+    uint64_t sourceLength = 0;
+    uint64_t sourcePosition = 0;
+    uint64_t deltaLength, targetLength, dataLength, instLength, addrLength;
+    uint8_t deltaIndicator;
+    uint8_t checksum[4];
+    Section data, insts, addrs;
+    uint64_t pos = 0;
+
+    if (indicator & VCD_TARGET) {
+        Logger::error(getClassName(), __FUNCTION__, "VCD_TARGET window is not supported");
+        return false;
+    }
+    if ((indicator & VCD_SOURCE) && (!m_delta.readVarint(sourceLength) || !m_delta.readVarint(sourcePosition)))
+        goto Error;
+    if (!m_delta.readVarint(deltaLength) || !m_delta.readVarint(targetLength) || !m_delta.readByte(deltaIndicator) ||
+        !m_delta.readVarint(dataLength) || !m_delta.readVarint(instLength) || !m_delta.readVarint(addrLength))
+        goto Error;
+    if (deltaIndicator != 0) {
+        Logger::error(getClassName(), __FUNCTION__, "Compressed sections are not supported");
+        return false;
+    }
+    // Each length is checked alone. Their sum can wrap around.
+    if (targetLength > MAX_TARGET_WINDOW || deltaLength > MAX_DELTA_WINDOW ||
+        dataLength > deltaLength || instLength > deltaLength - dataLength ||
+        addrLength > deltaLength - dataLength - instLength) {
+        Logger::error(getClassName(), __FUNCTION__, "Invalid window size");
+        return false;
+    }
+    if (indicator & VCD_ADLER32) {
+        for (size_t i = 0; i < sizeof(checksum); i++) {
+            if (!m_delta.readByte(checksum[i]))
+                goto Error;
+        }
+    }
+
+    // sum of the lengths is at most MAX_DELTA_WINDOW
+    if (dataLength + instLength + addrLength > (uint64_t) (m_delta.end - m_delta.pos))
+        goto Error;
+    data = { m_delta.pos, m_delta.pos + dataLength };
+    insts = { data.end, data.end + instLength };
+    addrs = { insts.end, insts.end + addrLength };
+    m_delta.pos = addrs.end;
+
+    memset(m_near, 0, sizeof(m_near));
+    memset(m_same, 0, sizeof(m_same));
+    m_nextSlot = 0;
+    m_window.resize(targetLength);
+
+    while (insts.pos < insts.end) {
+        uint8_t index;
+        insts.readByte(index);
+        for (int i = 0; i < 2; i++) {
+            const Instruction& inst = s_codeTable[index][i];
+            if (inst.type == InstructionType_NOOP)
+                continue;
+
+            uint64_t size = inst.size;
+            if (size == 0 && !insts.readVarint(size))
+                goto Error;
+            if (size > targetLength - pos)
+                goto Error;
+
+            switch (inst.type) {
+            case InstructionType_ADD:
+                if (size > (uint64_t) (data.end - data.pos))
+                    goto Error;
+                memcpy(m_window.data() + pos, data.pos, size);
+                data.pos += size;
+                break;
+
+            case InstructionType_RUN: {
+                uint8_t value;
+                if (!data.readByte(value))
+                    goto Error;
+                memset(m_window.data() + pos, value, size);
+                break;
+            }
+
+            case InstructionType_COPY: {
+                uint64_t address;
+                if (!decodeAddress(addrs, sourceLength + pos, inst.mode, address))
+                    goto Error;
+                uint64_t copied = 0;
+                if (address < sourceLength) {
+                    copied = min(size, sourceLength - address);
+                    if (!readSource(sourcePosition + address, m_window.data() + pos, copied))
+                        return false;
+                }
+                // target copy can overlap itself (repeated pattern). copy byte by byte.
+                uint64_t from = address + copied - sourceLength;
+                for (; copied < size; copied++) {
+                    m_window[pos + copied] = m_window[from++];
+                }
+                break;
+            }
+            }
+            pos += size;
+        }
+    }
+    if (pos != targetLength || data.pos != data.end || addrs.pos != addrs.end)
+        goto Error;
+
+    if (indicator & VCD_ADLER32) {
+        uLong expected = ((uLong) checksum[0] << 24) | (checksum[1] << 16) | (checksum[2] << 8) | checksum[3];
+        if (adler32(adler32(0L, Z_NULL, 0), m_window.data(), targetLength) != expected) {
+            Logger::error(getClassName(), __FUNCTION__, "Adler32 mismatch");
+            return false;
+        }
+    }
+    return m_writer->write(m_window.data(), targetLength);
+
+Error:
+    Logger::error(getClassName(), __FUNCTION__, "Corrupted delta window");
+    return false;
+}
+
+bool VCDiffDecoder::decodeAddress(Section& addresses, uint64_t here, uint8_t mode, uint64_t& address)
+{
+    uint64_t value;
+
+    if (mode == VCD_SELF) {
+        if (!addresses.readVarint(address))
+            return false;
+    } else if (mode == VCD_HERE) {
+        if (!addresses.readVarint(value) || value > here)
+            return false;
+        address = here - value;
+    } else if (mode < 2 + NEAR_SIZE) {
+        if (!addresses.readVarint(value))
+            return false;
+        address = m_near[mode - 2] + value;
+    } else {
+        uint8_t byte;
+        if (!addresses.readByte(byte))
+            return false;
+        address = m_same[(mode - 2 - NEAR_SIZE) * 256 + byte];
+    }
+    if (address >= here)
+        return false;
+
+    m_near[m_nextSlot] = address;
+    m_nextSlot = (m_nextSlot + 1) % NEAR_SIZE;
+    m_same[address % (SAME_SIZE * 256)] = address;
+    return true;
+}
+
+bool VCDiffDecoder::readSource(uint64_t offset, uint8_t* buffer, size_t size)
+{
+    while (size > 0) {
+        uint64_t index = offset / BLOCK_SIZE;
+        auto it = m_blockMap.find(index);
+        if (it != m_blockMap.end()) {
+            // most recently used block goes to the front
+            m_blocks.splice(m_blocks.begin(), m_blocks, it->second);
+        } else {
+            if (!m_blocks.empty() && m_blocks.size() * BLOCK_SIZE >= m_sourceWindow) {
+                uint64_t evicted = m_blocks.back().first;
+                posix_fadvise(m_sourceFd, evicted * BLOCK_SIZE, BLOCK_SIZE, POSIX_FADV_DONTNEED);
+                m_blockMap.erase(evicted);
+                m_blocks.pop_back();
+            }
+            m_blocks.emplace_front(index, vector<uint8_t>(BLOCK_SIZE));
+            vector<uint8_t>& block = m_blocks.front().second;
+            size_t length = 0;
+            while (length < BLOCK_SIZE) {
+                ssize_t rc = pread(m_sourceFd, block.data() + length, BLOCK_SIZE - length, index * BLOCK_SIZE + length);
+                if (rc < 0 && errno == EINTR)
+                    continue;
+                if (rc < 0) {
+                    Logger::error(getClassName(), __FUNCTION__, string("Failed to read source : ") + strerror(errno));
+                    m_blocks.pop_front();
+                    return false;
+                }
+                if (rc == 0)
+                    break;
+                length += rc;
+            }
+            block.resize(length);
+            m_blockMap[index] = m_blocks.begin();
+        }
+
+        vector<uint8_t>& block = m_blocks.front().second;
+        size_t start = offset % BLOCK_SIZE;
+        if (start >= block.size()) {
+            Logger::error(getClassName(), __FUNCTION__, "Source is shorter than the delta expects");
+            return false;
+        }
+        size_t length = min(size, block.size() - start);
+        memcpy(buffer, block.data() + start, length);
+        buffer += length;
+        offset += length;
+        size -= length;
+    }
+    return true;
+}
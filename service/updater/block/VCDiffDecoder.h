@@ -0,0 +1,119 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef UPDATER_BLOCK_VCDIFFDECODER_H_
+#define UPDATER_BLOCK_VCDIFFDECODER_H_
+
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "interface/IClassName.h"
+#include "updater/block/BlockWriter.h"
+
+using namespace std;
+
+// VCDIFF (RFC 3284) decoder for the deltas made by 'xdelta3 -S none'.
+// Secondary compression and application defined code tables are not supported.
+class VCDiffDecoder : public IClassName {
+public:
+    typedef function<void(uint64_t current, uint64_t total)> ProgressCallback;
+
+    VCDiffDecoder();
+    virtual ~VCDiffDecoder();
+
+    // Source blocks in this window are cached. Copies in it don't read the source partition again.
+    void setSourceWindow(size_t size)
+    {
+        m_sourceWindow = size;
+    }
+
+    // 'current' and 'total' are bytes of the delta file
+    void setProgressCallback(ProgressCallback callback)
+    {
+        m_progressCallback = callback;
+    }
+
+    bool decode(const string& source, const string& delta, BlockWriter& writer);
+
+private:
+    enum InstructionType {
+        InstructionType_NOOP = 0,
+        InstructionType_ADD,
+        InstructionType_RUN,
+        InstructionType_COPY,
+    };
+
+    struct Instruction {
+        uint8_t type;
+        uint8_t size;
+        uint8_t mode;
+    };
+
+    // sequence of bytes in memory
+    struct Section {
+        const uint8_t* pos;
+        const uint8_t* end;
+
+        bool readByte(uint8_t& value);
+        bool readVarint(uint64_t& value);
+    };
+
+    static const size_t BLOCK_SIZE = 4 * 1024 * 1024;
+    static const size_t DEFAULT_SOURCE_WINDOW = 64 * 1024 * 1024;
+    static const size_t MAX_TARGET_WINDOW = 64 * 1024 * 1024;
+    // sections of a window are used in place
+    static const size_t MAX_DELTA_WINDOW = 2 * MAX_TARGET_WINDOW;
+    static const size_t NEAR_SIZE = 4;
+    static const size_t SAME_SIZE = 3;
+
+    static void initCodeTable();
+    static Instruction s_codeTable[256][2];
+
+    bool open(const string& source, const string& delta);
+    void close();
+
+    bool readHeader();
+    bool decodeWindow(uint8_t indicator);
+    bool decodeAddress(Section& addresses, uint64_t here, uint8_t mode, uint64_t& address);
+    bool readSource(uint64_t offset, uint8_t* buffer, size_t size);
+
+    size_t m_sourceWindow;
+    ProgressCallback m_progressCallback;
+
+    int m_sourceFd;
+    BlockWriter* m_writer;
+    // whole delta file is mapped. 'm_delta' is the part not decoded yet.
+    const uint8_t* m_deltaData;
+    size_t m_deltaSize;
+    Section m_delta;
+
+    // LRU cache of source blocks
+    list<pair<uint64_t, vector<uint8_t>>> m_blocks;
+    map<uint64_t, list<pair<uint64_t, vector<uint8_t>>>::iterator> m_blockMap;
+
+    // address cache
+    uint64_t m_near[NEAR_SIZE];
+    uint64_t m_same[SAME_SIZE * 256];
+    size_t m_nextSlot;
+
+    vector<uint8_t> m_window;
+};
+
+#endif /* UPDATER_BLOCK_VCDIFFDECODER_H_ */
@@ -0,0 +1,237 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "updater/block/ZstdDecoder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <zstd.h>
+
+#include "util/Logger.h"
+
+ZstdDecoder::ZstdDecoder()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_nextFrame(0)
+    , m_writtenFrame(0)
+    , m_lookahead(0)
+    , m_isStopping(false)
+{
+    setClassName("ZstdDecoder");
+}
+
+ZstdDecoder::~ZstdDecoder()
+{
+}
+
+bool ZstdDecoder::decode(const string& path, AbsUpdateStream& output)
+{
+    Logger::info(getClassName(), __FUNCTION__, path);
+
+    struct stat st;
+    bool result = false;
+    bool isParallel = true;
+    size_t maxContentSize = 0;
+    void* data = MAP_FAILED;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        Logger::error(getClassName(), __FUNCTION__, "Failed to open " + path + " : " + strerror(errno));
+        goto Done;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        Logger::error(getClassName(), __FUNCTION__, "Failed to mmap " + path + " : " + strerror(errno));
+        goto Done;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    m_data = (const uint8_t*) data;
+    m_size = st.st_size;
+
+    // Find frames. Skippable frames (i.e. seek table) are found too, and decompressed to nothing.
+    // Frames are decompressed in parallel only if all of them have small enough content size in their headers.
+    m_frames.clear();
+    for (size_t offset = 0; offset < m_size;) {
+        size_t size = ZSTD_findFrameCompressedSize(m_data + offset, m_size - offset);
+        if (ZSTD_isError(size)) {
+            Logger::error(getClassName(), __FUNCTION__, string("Invalid frame : ") + ZSTD_getErrorName(size));
+            goto Done;
+        }
+        unsigned long long contentSize = ZSTD_getFrameContentSize(m_data + offset, size);
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize > MAX_FRAME_SIZE) {
+            isParallel = false;
+            contentSize = 0;
+        }
+        m_frames.push_back({ m_data + offset, size, (size_t) contentSize, {}, false, false });
+        maxContentSize = max(maxContentSize, (size_t) contentSize);
+        offset += size;
+    }
+    LOG_DEBUG(getClassName(), __FUNCTION__, to_string(m_frames.size()) + " frames");
+
+    if (m_frames.size() == 1 || !isParallel) {
+        result = decodeStream(output);
+    } else {
+        result = decodeFrames(output, maxContentSize);
+    }
+
+Done:
+    if (data != MAP_FAILED)
+        munmap(data, st.st_size);
+    if (fd >= 0)
+        ::close(fd);
+    m_frames.clear();
+    m_data = nullptr;
+    m_size = 0;
+    return result;
+}
+
+bool ZstdDecoder::decodeStream(AbsUpdateStream& writer)
+{
+    // single frame cannot be decompressed in parallel
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    vector<uint8_t> buffer(ZSTD_DStreamOutSize());
+    ZSTD_inBuffer input = { m_data, m_size, 0 };
+    size_t rc = ZSTD_initDStream(stream);
+    bool result = false;
+
+    while (!ZSTD_isError(rc) && (input.pos < input.size || rc != 0)) {
+        ZSTD_outBuffer output = { buffer.data(), buffer.size(), 0 };
+        size_t pos = input.pos;
+        rc = ZSTD_decompressStream(stream, &output, &input);
+        if (ZSTD_isError(rc))
+            break;
+        if (!writer.write((const char*) buffer.data(), output.pos))
+            goto Done;
+        if (input.pos == pos && output.pos == 0) {
+            // no progress : truncated input
+            break;
+        }
+        if (m_progressCallback)
+            m_progressCallback(input.pos, m_size);
+    }
+    if (ZSTD_isError(rc) || rc != 0) {
+        Logger::error(getClassName(), __FUNCTION__, string("Failed to decompress : ") + (ZSTD_isError(rc) ? ZSTD_getErrorName(rc) : "truncated"));
+        goto Done;
+    }
+    result = true;
+
+Done:
+    ZSTD_freeDStream(stream);
+    return result;
+}
+
+bool ZstdDecoder::decodeFrames(AbsUpdateStream& writer, size_t maxContentSize)
+{
+    // Memory is bounded by the frames decompressed ahead of the writer
+    size_t maxFrames = max(MAX_BUFFERED_SIZE / max(maxContentSize, (size_t) 1), (size_t) 1);
+    size_t threadCount = max(1u, thread::hardware_concurrency());
+    threadCount = min(threadCount, m_frames.size());
+    threadCount = min(threadCount, maxFrames);
+    vector<thread> workers;
+    size_t current = 0;
+    bool result = true;
+
+    m_nextFrame = 0;
+    m_writtenFrame = 0;
+    m_lookahead = min(threadCount * 2, maxFrames);
+    m_isStopping = false;
+    Logger::info(getClassName(), __FUNCTION__, to_string(threadCount) + " threads");
+    for (size_t i = 0; i < threadCount; i++) {
+        workers.push_back(thread(&ZstdDecoder::runWorker, this));
+    }
+
+    // write the decompressed frames in order
+    for (size_t i = 0; i < m_frames.size(); i++) {
+        Frame& frame = m_frames[i];
+        unique_lock<mutex> lock(m_mutex);
+        m_condition.wait(lock, [&frame] { return frame.isDone; });
+        lock.unlock();
+
+        if (frame.isFailed || !writer.write((const char*) frame.output.data(), frame.output.size())) {
+            result = false;
+            break;
+        }
+        vector<uint8_t>().swap(frame.output);
+        current += frame.size;
+        if (m_progressCallback)
+            m_progressCallback(current, m_size);
+
+        lock.lock();
+        m_writtenFrame = i + 1;
+        m_condition.notify_all();
+    }
+
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_isStopping = true;
+        m_condition.notify_all();
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    return result;
+}
+
+void ZstdDecoder::runWorker()
+{
+    while (true) {
+        unique_lock<mutex> lock(m_mutex);
+        // Don't go too far ahead of the writer. Decompressed frames are kept in memory.
+        m_condition.wait(lock, [this] {
+            return m_isStopping || m_nextFrame >= m_frames.size() || m_nextFrame < m_writtenFrame + m_lookahead;
+        });
+        if (m_isStopping || m_nextFrame >= m_frames.size())
+            return;
+        Frame& frame = m_frames[m_nextFrame++];
+        lock.unlock();
+
+        // The whole frame is allocated at once. Out of memory fails the image, not the process.
+        bool result = false;
+        try {
+            result = decompressFrame(frame);
+        }
+        catch (const bad_alloc &e) {
+            Logger::error(getClassName(), __FUNCTION__, "Out of memory");
+        }
+
+        lock.lock();
+        frame.isFailed = !result;
+        frame.isDone = true;
+        m_condition.notify_all();
+    }
+}
+
+bool ZstdDecoder::decompressFrame(Frame& frame)
+{
+    // content size is checked in 'decode'. It is at most MAX_FRAME_SIZE.
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    frame.output.resize(frame.contentSize);
+    size_t rc = ZSTD_decompressDCtx(context, frame.output.data(), frame.output.size(), frame.data, frame.size);
+    ZSTD_freeDCtx(context);
+    if (!ZSTD_isError(rc))
+        frame.output.resize(rc);
+    if (ZSTD_isError(rc)) {
+        Logger::error(getClassName(), __FUNCTION__, string("Failed to decompress : ") + ZSTD_getErrorName(rc));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef UPDATER_BLOCK_ZSTDDECODER_H_
+#define UPDATER_BLOCK_ZSTDDECODER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "interface/IClassName.h"
+#include "updater/AbsUpdater.h"
+
+using namespace std;
+
+// Decompresses a zstd image into the partition.
+// Images made of several independent frames (pzstd, seekable format) are decompressed on all cores.
+class ZstdDecoder : public IClassName {
+public:
+    typedef function<void(uint64_t current, uint64_t total)> ProgressCallback;
+
+    ZstdDecoder();
+    virtual ~ZstdDecoder();
+
+    // 'current' and 'total' are bytes of the compressed file
+    void setProgressCallback(ProgressCallback callback)
+    {
+        m_progressCallback = callback;
+    }
+
+    bool decode(const string& path, AbsUpdateStream& output);
+
+private:
+    // Each frame is decompressed into memory on the parallel path. Larger frames are streamed.
+    static const size_t MAX_FRAME_SIZE = 32 * 1024 * 1024;
+    // decompressed frames kept in memory at once
+    static const size_t MAX_BUFFERED_SIZE = 128 * 1024 * 1024;
+
+    struct Frame {
+        const uint8_t* data;
+        size_t size;
+        size_t contentSize;
+        vector<uint8_t> output;
+        bool isDone;
+        bool isFailed;
+    };
+
+    bool decodeStream(AbsUpdateStream& writer);
+    bool decodeFrames(AbsUpdateStream& writer, size_t maxContentSize);
+    void runWorker();
+    bool decompressFrame(Frame& frame);
+
+    ProgressCallback m_progressCallback;
+
+    const uint8_t* m_data;
+    size_t m_size;
+    vector<Frame> m_frames;
+
+    // frames are taken by workers in order, and written in order
+    mutex m_mutex;
+    condition_variable m_condition;
+    size_t m_nextFrame;
+    size_t m_writtenFrame;
+    size_t m_lookahead;
+    bool m_isStopping;
+};
+
+#endif /* UPDATER_BLOCK_ZSTDDECODER_H_ */
@@ -73,9 +73,9 @@ void OSTree::unlock()
     ostree_sysroot_unlock(m_sysroot);
 }
 
-bool OSTree::deploy(const string& path, PartitionLabel partLabel)
+bool OSTree::deploy(const string& path, PartitionLabel partLabel, const DeployOptions& options, DeployResult& result)
 {
-    Logger::verbose(getClassName(), __FUNCTION__);
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
 
     // extract revision from filename : ostree-630d1ec5-fc6a8911.{HASH}.delta
     // TODO if we know the file format, it will be able to extract the revision.
@@ -159,7 +159,7 @@ Error:
 
 bool OSTree::undeploy()
 {
-    Logger::verbose(getClassName(), __FUNCTION__);
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
 
     gboolean changed;
     g_autoptr(GError) gerror = NULL;
@@ -209,7 +209,7 @@ Error:
 
 bool OSTree::setReadWriteMode()
 {
-    Logger::verbose(getClassName(), __FUNCTION__);
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
 
     gboolean changed;
     g_autoptr(GError) gerror = NULL;
@@ -234,7 +234,7 @@ bool OSTree::setReadWriteMode()
 
 bool OSTree::isUpdated()
 {
-    Logger::verbose(getClassName(), __FUNCTION__);
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
 
     gboolean changed;
     g_autoptr(GError) gerror = NULL;
@@ -251,7 +251,7 @@ bool OSTree::isUpdated()
 
 void OSTree::printDebug()
 {
-    Logger::verbose(getClassName(), __FUNCTION__);
+    LOG_VERBOSE(getClassName(), __FUNCTION__);
 
     gboolean changed;
     g_autoptr(GError) gerror = NULL;
@@ -32,7 +32,7 @@ public:
     virtual bool onInitialization() override;
     virtual bool onFinalization() override;
 
-    virtual bool deploy(const string& path, PartitionLabel partLabel) override;
+    virtual bool deploy(const string& path, PartitionLabel partLabel, const DeployOptions& options, DeployResult& result) override;
     virtual bool undeploy() override;
     virtual bool setReadWriteMode() override;
     virtual bool isUpdated() override;
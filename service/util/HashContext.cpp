@@ -0,0 +1,148 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "util/HashContext.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+// Saved contexts are only valid for the same OpenSSL build.
+// Sizes are compared on load to reject files written by another one.
+struct HashContextHeader {
+    uint32_t magic;
+    uint32_t sha1Size;
+    uint32_t md5Size;
+    uint32_t sha256Size;
+    uint64_t size;
+};
+
+const uint32_t HASH_CONTEXT_MAGIC = 0x48535755; // "UWSH"
+
+}
+
+HashContext::HashContext()
+{
+    reset();
+}
+
+HashContext::~HashContext()
+{
+}
+
+void HashContext::reset()
+{
+    SHA1_Init(&m_sha1);
+    MD5_Init(&m_md5);
+    SHA256_Init(&m_sha256);
+    m_size = 0;
+}
+
+void HashContext::update(const void* data, size_t size)
+{
+    if (size == 0)
+        return;
+
+    SHA1_Update(&m_sha1, data, size);
+    MD5_Update(&m_md5, data, size);
+    SHA256_Update(&m_sha256, data, size);
+    m_size += size;
+}
+
+string HashContext::getSha1() const
+{
+    // Finalizing destroys the context, so work on a copy
+    SHA_CTX ctx = m_sha1;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1_Final(digest, &ctx);
+    return toHex(digest, sizeof(digest));
+}
+
+string HashContext::getMd5() const
+{
+    MD5_CTX ctx = m_md5;
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    MD5_Final(digest, &ctx);
+    return toHex(digest, sizeof(digest));
+}
+
+string HashContext::getSha256() const
+{
+    SHA256_CTX ctx = m_sha256;
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256_Final(digest, &ctx);
+    return toHex(digest, sizeof(digest));
+}
+
+bool HashContext::save(const string& filename) const
+{
+    HashContextHeader header = { HASH_CONTEXT_MAGIC, sizeof(m_sha1), sizeof(m_md5), sizeof(m_sha256), m_size };
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(&m_sha1, sizeof(m_sha1), 1, file) == 1 &&
+                  fwrite(&m_md5, sizeof(m_md5), 1, file) == 1 &&
+                  fwrite(&m_sha256, sizeof(m_sha256), 1, file) == 1;
+    fclose(file);
+    return result;
+}
+
+bool HashContext::load(const string& filename)
+{
+    HashContextHeader header;
+    SHA_CTX sha1;
+    MD5_CTX md5;
+    SHA256_CTX sha256;
+
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+    bool result = fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.magic == HASH_CONTEXT_MAGIC &&
+                  header.sha1Size == sizeof(sha1) &&
+                  header.md5Size == sizeof(md5) &&
+                  header.sha256Size == sizeof(sha256) &&
+                  fread(&sha1, sizeof(sha1), 1, file) == 1 &&
+                  fread(&md5, sizeof(md5), 1, file) == 1 &&
+                  fread(&sha256, sizeof(sha256), 1, file) == 1;
+    fclose(file);
+    if (!result) {
+        return false;
+    }
+
+    m_sha1 = sha1;
+    m_md5 = md5;
+    m_sha256 = sha256;
+    m_size = header.size;
+    return true;
+}
+
+string HashContext::toHex(const unsigned char* digest, size_t length)
+{
+    static const char HEX[] = "0123456789abcdef";
+    string hex;
+    hex.reserve(length * 2);
+    for (size_t i = 0; i < length; i++) {
+        hex += HEX[digest[i] >> 4];
+        hex += HEX[digest[i] & 0x0f];
+    }
+    return hex;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2021 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef UTIL_HASHCONTEXT_H_
+#define UTIL_HASHCONTEXT_H_
+
+#include <iostream>
+#include <stdint.h>
+
+// SHA_CTX and friends are deprecated in OpenSSL 3.0, but they are the only
+// contexts which can be saved to a file and restored later.
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/md5.h>
+#include <openssl/sha.h>
+
+using namespace std;
+
+// Streaming SHA1/MD5/SHA256 of a file which is written sequentially.
+// The context can be saved and loaded, so a resumed download continues hashing.
+class HashContext {
+public:
+    HashContext();
+    virtual ~HashContext();
+
+    void reset();
+    void update(const void* data, size_t size);
+
+    // number of hashed bytes
+    uint64_t getSize()
+    {
+        return m_size;
+    }
+
+    // digests of the bytes hashed so far (lowercase hex)
+    string getSha1() const;
+    string getMd5() const;
+    string getSha256() const;
+
+    bool save(const string& filename) const;
+    bool load(const string& filename);
+
+private:
+    static string toHex(const unsigned char* digest, size_t length);
+
+    SHA_CTX m_sha1;
+    MD5_CTX m_md5;
+    SHA256_CTX m_sha256;
+    uint64_t m_size;
+};
+
+#endif /* UTIL_HASHCONTEXT_H_ */
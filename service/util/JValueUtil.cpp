@@ -88,6 +88,19 @@ bool JValueUtil::getValue(const JValue& json, const string& key, int& value)
     return true;
 }
 
+bool JValueUtil::getValue(const JValue& json, const string& key, int64_t& value)
+{
+    if (!json.hasKey(key))
+        return false;
+    if (!json[key].isNumber())
+        return false;
+    if (json[key].asNumber<int64_t>(value) != CONV_OK) {
+        value = 0;
+        return false;
+    }
+    return true;
+}
+
 string JValueUtil::getMeta(const JValue& json, const string& key)
 {
     if (!json.isValid() || json.isNull() || !json.isArray())
@@ -16,6 +16,7 @@
 
 #include <iostream>
 #include <pbnjson.hpp>
+#include <stdint.h>
 
 using namespace std;
 using namespace pbnjson;
@@ -34,6 +35,7 @@ public:
     static bool getValue(const JValue& json, const string& mainKey, const string& subKey, int& value);
     static bool getValue(const JValue& json, const string& key, string& value);
     static bool getValue(const JValue& json, const string& key, int& value);
+    static bool getValue(const JValue& json, const string& key, int64_t& value);
 
     static string getMeta(const JValue& json, const string& key);
 };
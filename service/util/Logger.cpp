@@ -15,9 +15,16 @@
 
 #include <PmLogLib.h>
 
+#include <signal.h>
 #include <string.h>
+#include <unistd.h>
 
 const string Logger::EMPTY = "";
+const int Logger::DRAIN_INTERVAL;
+const size_t Logger::MAX_CRASH_RINGS;
+struct sigaction Logger::s_prevActions[NSIG];
+
+static const int FATAL_SIGNALS[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
 
 void Logger::verbose(const string& main, string msg)
 {
@@ -96,14 +103,41 @@ const string& Logger::toString(const enum LogLevel& level)
     return DEBUG;
 }
 
+Logger::RingHolder::~RingHolder()
+{
+    // Queued logs are still written after the thread is finished
+    if (ring)
+        ring->isOrphan = true;
+}
+
+void Logger::onFatalSignal(int signo, siginfo_t* info, void* context)
+{
+    // Best effort. Logs just before the crash are the most useful ones.
+    getInstance().writeCrashLogs();
+
+    // Chain to the previous handler (or the default action)
+    sigaction(signo, &s_prevActions[signo], nullptr);
+    // A fault happens again when this handler returns. Others (kill, abort) are raised again.
+    if (info == nullptr || info->si_code <= 0)
+        raise(signo);
+}
+
 Logger::Logger()
     : m_level(LogLevel_DEBUG)
     , m_type(LogType_PMLOG)
+    , m_isAsync(false)
+    , m_seq(0)
+    , m_hasPending(false)
+    , m_isStopping(false)
 {
+    for (auto& slot : m_crashRings) {
+        slot = nullptr;
+    }
 }
 
 Logger::~Logger()
 {
+    setAsync(false);
 }
 
 void Logger::setLevel(enum LogLevel level)
@@ -116,9 +150,210 @@ void Logger::setType(enum LogType type)
     m_type = type;
 }
 
+void Logger::setAsync(bool isAsync)
+{
+    if (m_isAsync == isAsync)
+        return;
+
+    if (isAsync) {
+        m_isStopping = false;
+        m_thread = thread(&Logger::run, this);
+        m_isAsync = true;
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &Logger::onFatalSignal;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        for (int signo : FATAL_SIGNALS) {
+            sigaction(signo, &action, &s_prevActions[signo]);
+        }
+        return;
+    }
+
+    for (int signo : FATAL_SIGNALS) {
+        sigaction(signo, &s_prevActions[signo], nullptr);
+    }
+    m_isAsync = false;
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_isStopping = true;
+        m_condition.notify_all();
+    }
+    if (m_thread.joinable())
+        m_thread.join();
+    flush();
+}
+
+void Logger::flush()
+{
+    // Wait a moment for the logging thread. It may be stuck if the process is crashing.
+    for (int i = 0; i < 100; i++) {
+        if (m_drainMutex.try_lock()) {
+            while (drain());
+            m_drainMutex.unlock();
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    cout.flush();
+}
+
+bool Logger::push(const enum LogLevel level, string& log)
+{
+    Ring* ring = getRing();
+    size_t head = ring->head.load(memory_order_relaxed);
+    if (head - ring->tail.load(memory_order_acquire) >= Ring::CAPACITY) {
+        ring->dropped++;
+        return false;
+    }
+
+    Ring::Entry& entry = ring->entries[head % Ring::CAPACITY];
+    entry.seq = m_seq++;
+    entry.level = level;
+    entry.log.swap(log);
+    ring->head.store(head + 1, memory_order_release);
+
+    // Wake up the logging thread only if it is not notified yet
+    if (!m_hasPending.exchange(true) || level == LogLevel_ERROR)
+        m_condition.notify_one();
+    return true;
+}
+
+Logger::Ring* Logger::getRing()
+{
+    static thread_local RingHolder holder;
+
+    if (!holder.ring) {
+        holder.ring = make_shared<Ring>();
+        lock_guard<mutex> lock(m_ringsMutex);
+        m_rings.push_back(holder.ring);
+        for (auto& slot : m_crashRings) {
+            Ring* empty = nullptr;
+            if (slot.compare_exchange_strong(empty, holder.ring.get()))
+                break;
+        }
+    }
+    return holder.ring.get();
+}
+
+void Logger::run()
+{
+    unique_lock<mutex> lock(m_mutex);
+    while (!m_isStopping) {
+        m_condition.wait_for(lock, chrono::milliseconds(DRAIN_INTERVAL), [this] { return m_hasPending || m_isStopping; });
+        m_hasPending = false;
+        lock.unlock();
+        {
+            lock_guard<mutex> drainLock(m_drainMutex);
+            while (drain());
+        }
+        if (m_type == LogType_CONSOLE)
+            cout.flush();
+        lock.lock();
+    }
+}
+
+bool Logger::drain()
+{
+    vector<shared_ptr<Ring>> rings;
+    {
+        lock_guard<mutex> lock(m_ringsMutex);
+        // Rings of finished threads are released once they are empty
+        for (auto it = m_rings.begin(); it != m_rings.end();) {
+            Ring* ring = it->get();
+            if (ring->isOrphan && ring->tail == ring->head && ring->dropped == 0) {
+                for (auto& slot : m_crashRings) {
+                    Ring* released = ring;
+                    slot.compare_exchange_strong(released, nullptr);
+                }
+                it = m_rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        rings = m_rings;
+    }
+
+    bool isWritten = false;
+    for (auto& ring : rings) {
+        uint64_t dropped = ring->dropped.exchange(0);
+        if (dropped > 0) {
+            string log = toString(LogLevel_WARNING) + "[Logger] " + to_string(dropped) + " logs are dropped";
+            m_type == LogType_CONSOLE ? writeConsole(LogLevel_WARNING, log) : writePmlog(LogLevel_WARNING, log);
+            isWritten = true;
+        }
+    }
+
+    // Logs of all threads in the order of 'seq'
+    while (true) {
+        Ring* next = nullptr;
+        uint64_t nextSeq = 0;
+        for (auto& ring : rings) {
+            size_t tail = ring->tail.load(memory_order_relaxed);
+            if (tail == ring->head.load(memory_order_acquire))
+                continue;
+            uint64_t seq = ring->entries[tail % Ring::CAPACITY].seq;
+            if (next == nullptr || seq < nextSeq) {
+                next = ring.get();
+                nextSeq = seq;
+            }
+        }
+        if (next == nullptr)
+            break;
+
+        size_t tail = next->tail.load(memory_order_relaxed);
+        Ring::Entry& entry = next->entries[tail % Ring::CAPACITY];
+        m_type == LogType_CONSOLE ? writeConsole(entry.level, entry.log) : writePmlog(entry.level, entry.log);
+        entry.log.clear();
+        next->tail.store(tail + 1, memory_order_release);
+        isWritten = true;
+    }
+    return isWritten;
+}
+
+void Logger::writeCrashLogs()
+{
+    // Positions are kept on the stack. The logging thread may still be running.
+    size_t tails[MAX_CRASH_RINGS];
+    for (size_t i = 0; i < MAX_CRASH_RINGS; i++) {
+        Ring* ring = m_crashRings[i].load(memory_order_acquire);
+        tails[i] = ring ? ring->tail.load(memory_order_acquire) : 0;
+    }
+
+    // Logs of all threads in the order of 'seq'
+    while (true) {
+        Ring* next = nullptr;
+        size_t nextIndex = 0;
+        uint64_t nextSeq = 0;
+        for (size_t i = 0; i < MAX_CRASH_RINGS; i++) {
+            Ring* ring = m_crashRings[i].load(memory_order_acquire);
+            if (ring == nullptr)
+                continue;
+            // Nothing left, or the slot is reused by another ring
+            size_t pending = ring->head.load(memory_order_acquire) - tails[i];
+            if (pending == 0 || pending > Ring::CAPACITY)
+                continue;
+            uint64_t seq = ring->entries[tails[i] % Ring::CAPACITY].seq;
+            if (next == nullptr || seq < nextSeq) {
+                next = ring;
+                nextIndex = i;
+                nextSeq = seq;
+            }
+        }
+        if (next == nullptr)
+            break;
+
+        const Ring::Entry& entry = next->entries[tails[nextIndex]++ % Ring::CAPACITY];
+        if (::write(STDERR_FILENO, entry.log.data(), entry.log.size()) < 0 ||
+            ::write(STDERR_FILENO, "\n", 1) < 0)
+            break;
+    }
+}
+
 void Logger::write(const enum LogLevel level, const string& main, const string& sub, const string& msg)
 {
-    if (level < m_level)
+    if (!isEnabled(level))
         return;
 
     string log = toString(level);
@@ -130,6 +365,12 @@ void Logger::write(const enum LogLevel level, const string& main, const string&
     }
     log += " " + msg;
 
+    if (m_isAsync) {
+        // If the ring is full, the log is dropped and reported by the logging thread.
+        push(level, log);
+        return;
+    }
+
     switch (m_type) {
     case LogType_CONSOLE:
         writeConsole(level, log);
@@ -151,12 +392,15 @@ void Logger::writeConsole(const enum LogLevel& level, const string& log)
     case LogLevel_VERBOSE:
     case LogLevel_DEBUG:
     case LogLevel_INFO:
-        cout << log << endl;
+        // 'cout' is flushed after each batch of the logging thread
+        cout << log << '\n';
+        if (!m_isAsync)
+            cout.flush();
         break;
 
     case LogLevel_WARNING:
     case LogLevel_ERROR:
-        cerr << log << endl;
+        cerr << log << '\n';
         break;
     }
 }
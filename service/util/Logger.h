@@ -14,8 +14,16 @@
 #ifndef UTIL_LOGGER_H_
 #define UTIL_LOGGER_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -32,6 +40,25 @@ enum LogType {
     LogType_PMLOG
 };
 
+// Logs below this level are removed at compile time
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LogLevel_VERBOSE
+#endif
+
+// Same as Logger::verbose(...) and so on, but the arguments are not evaluated if the level is disabled.
+// Use them when the message is expensive to build. (i.e. stringify of JSON)
+#define LOG_WRITE(level, func, ...) \
+    do { \
+        if ((level) >= LOG_MIN_LEVEL && Logger::getInstance().isEnabled(level)) \
+            Logger::func(__VA_ARGS__); \
+    } while (0)
+
+#define LOG_VERBOSE(...)    LOG_WRITE(LogLevel_VERBOSE, verbose, __VA_ARGS__)
+#define LOG_DEBUG(...)      LOG_WRITE(LogLevel_DEBUG, debug, __VA_ARGS__)
+#define LOG_INFO(...)       LOG_WRITE(LogLevel_INFO, info, __VA_ARGS__)
+#define LOG_WARNING(...)    LOG_WRITE(LogLevel_WARNING, warning, __VA_ARGS__)
+#define LOG_ERROR(...)      LOG_WRITE(LogLevel_ERROR, error, __VA_ARGS__)
+
 class Logger {
 public:
     static void verbose(const string& main, string msg);
@@ -55,15 +82,59 @@ public:
 
     void setLevel(enum LogLevel level);
     void setType(enum LogType type);
+    // Logs are queued on the caller's thread and written on the logging thread
+    void setAsync(bool isAsync);
+    // Write all queued logs now
+    void flush();
     bool isVerbose()
     {
         return m_level == LogLevel_VERBOSE;
     }
 
+    bool isEnabled(enum LogLevel level)
+    {
+        return level >= LOG_MIN_LEVEL && level >= m_level;
+    }
+
 private:
+    // Single producer (the owner thread) and single consumer (the logging thread). No lock to push.
+    struct Ring {
+        static const size_t CAPACITY = 512;
+
+        struct Entry {
+            uint64_t seq;
+            enum LogLevel level;
+            string log;
+        };
+
+        Ring() : head(0), tail(0), dropped(0), isOrphan(false) {}
+
+        Entry entries[CAPACITY];
+        // next entry to push / pop
+        atomic<size_t> head;
+        atomic<size_t> tail;
+        // logs which are dropped because the ring is full
+        atomic<uint64_t> dropped;
+        // the owner thread is finished
+        atomic<bool> isOrphan;
+    };
+
+    struct RingHolder {
+        ~RingHolder();
+        shared_ptr<Ring> ring;
+    };
+
     static const string EMPTY;
+    static const int DRAIN_INTERVAL = 100;
+    // Rings of more threads are not written on crash
+    static const size_t MAX_CRASH_RINGS = 64;
 
     static const string& toString(const enum LogLevel& level);
+    // Only async-signal-safe calls are allowed here
+    static void onFatalSignal(int signo, siginfo_t* info, void* context);
+
+    // handlers which were installed before 'setAsync(true)'
+    static struct sigaction s_prevActions[NSIG];
 
     Logger();
 
@@ -71,8 +142,31 @@ private:
     void writeConsole(const enum LogLevel& level, const string& log);
     void writePmlog(const enum LogLevel& level, const string& log);
 
+    bool push(const enum LogLevel level, string& log);
+    Ring* getRing();
+    void run();
+    // returns false if nothing is written
+    bool drain();
+    // Write queued logs to stderr with write(2) only. The rings are not changed.
+    void writeCrashLogs();
+
     enum LogLevel m_level;
     enum LogType m_type;
+
+    atomic<bool> m_isAsync;
+    atomic<uint64_t> m_seq;
+    mutex m_ringsMutex;
+    vector<shared_ptr<Ring>> m_rings;
+    // Same rings without lock for the signal handler
+    atomic<Ring*> m_crashRings[MAX_CRASH_RINGS];
+    // only one consumer at a time (logging thread or 'flush')
+    mutex m_drainMutex;
+
+    thread m_thread;
+    mutex m_mutex;
+    condition_variable m_condition;
+    atomic<bool> m_hasPending;
+    bool m_isStopping;
 };
 
 #endif /* UTIL_LOGGER_H_ */